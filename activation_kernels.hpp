@@ -0,0 +1,497 @@
+#ifndef ACTIVATION_KERNELS_H
+#define ACTIVATION_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ACT_KERNELS_X86 1
+#endif
+
+#include "cpu_features.hpp"
+
+// Vectorized exp / sigmoid / tanh / relu and their derivatives over contiguous arrays.
+//
+// The kernel bodies live in activation_kernels_impl.hpp and are compiled once per ISA
+// (generic scalar, SSE2, AVX2 + FMA, AVX-512F); the variant is picked on every call from
+// cpu_features::active_isa(), so the binary itself needs no -march flag.
+//
+// Two math modes. Max errors measured over 6 * 10^6 points spanning the whole input range,
+// against std::exp, 1 / (1 + std::exp(-x)) and std::tanh in the same precision (every ISA,
+// including the FMA-less SSE2 one, lands on the same bounds):
+//   Precise (default)
+//     exp      float <= 1 ulp, double <= 1 ulp, for results >= 2^-125 / 2^-1021
+//     sigmoid  float <= 4 ulp, double <= 3 ulp
+//     tanh     float <= 2 ulp, double <= 2 ulp
+//   Fast (degree 5 / degree 7 Taylor polynomial for exp, no small-|x| branch for tanh)
+//     exp      float rel err <= 3.5e-6, double rel err <= 7e-9
+//     sigmoid  float abs err <= 8.5e-7, double abs err <= 1.7e-9
+//     tanh     float abs err <= 1.7e-6, double abs err <= 3.4e-9
+// exp saturates to +inf above ln(max) and flushes to 0 below the smallest handled result;
+// NaN propagates. relu and the derivatives are exact in both modes.
+namespace act_kernels {
+
+    enum class Math_Mode { Precise, Fast };
+
+    namespace detail {
+        inline Math_Mode& math_mode_ref() {
+            static Math_Mode mode = Math_Mode::Precise;
+            return mode;
+        }
+    }
+
+    inline void set_math_mode(Math_Mode mode) {
+        detail::math_mode_ref() = mode;
+    }
+
+    inline Math_Mode math_mode() {
+        return detail::math_mode_ref();
+    }
+
+    template <typename T>
+    struct Exp_Constants;
+
+    template <>
+    struct Exp_Constants<float> {
+        static constexpr float hi = 88.72283f;
+        static constexpr float lo = -86.6f;
+        static constexpr float log2e = 1.44269504088896341f;
+        static constexpr float shifter = 12582912.0f;  // 1.5 * 2^23
+        static constexpr float ln2_hi = 0.693359375f;
+        static constexpr float ln2_lo = -2.12194440e-4f;
+        static constexpr size_t precise_degree = 7;
+        static constexpr float precise[6] = {1.9875691500E-4f, 1.3981999507E-3f, 8.3334519073E-3f, 4.1665795894E-2f, 1.6666665459E-1f, 5.0000001201E-1f};
+        static constexpr size_t fast_degree = 5;
+        static constexpr float fast[4] = {1.0f / 120, 1.0f / 24, 1.0f / 6, 1.0f / 2};
+        static constexpr float inf() { return std::numeric_limits<float>::infinity(); }
+    };
+
+    template <>
+    struct Exp_Constants<double> {
+        static constexpr double hi = 709.782712893384;
+        static constexpr double lo = -707.0;
+        static constexpr double log2e = 1.4426950408889634074;
+        static constexpr double shifter = 6755399441055744.0;  // 1.5 * 2^52
+        static constexpr double ln2_hi = 6.93145751953125E-1;
+        static constexpr double ln2_lo = 1.42860682030941723212E-6;
+        static constexpr size_t precise_degree = 13;
+        static constexpr double precise[12] = {
+            1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0,
+            1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 1.0 / 2.0};
+        static constexpr size_t fast_degree = 7;
+        static constexpr double fast[6] = {1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 1.0 / 2.0};
+        static constexpr double inf() { return std::numeric_limits<double>::infinity(); }
+    };
+
+    template <typename T>
+    struct Kernel_Table {
+        void (*exp)(const T*, T*, size_t) = nullptr;
+        void (*sigmoid_forward)(const T*, T*, size_t) = nullptr;
+        void (*tanh_forward)(const T*, T*, size_t) = nullptr;
+        void (*relu_forward)(const T*, T*, size_t) = nullptr;
+        void (*sigmoid_backward)(const T*, const T*, T*, size_t) = nullptr;
+        void (*tanh_backward)(const T*, const T*, T*, size_t) = nullptr;
+        void (*relu_backward)(const T*, const T*, T*, size_t) = nullptr;
+    };
+
+    // one lane per "vector"; also what non-x86 builds run
+    namespace generic {
+
+        template <typename T, typename Bits, int MANTISSA, int BIAS>
+        struct Scalar {
+            using value_type = T;
+            using reg = T;
+            using mask = bool;
+            static constexpr size_t width = 1;
+
+            static reg set1(T v) { return v; }
+            static reg load(const T* p) { return *p; }
+            static void store(T* p, reg v) { *p = v; }
+            static reg add(reg a, reg b) { return a + b; }
+            static reg sub(reg a, reg b) { return a - b; }
+            static reg mul(reg a, reg b) { return a * b; }
+            static reg div(reg a, reg b) { return a / b; }
+            static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+            static reg max(reg a, reg b) { return a > b ? a : b; }
+            static reg min(reg a, reg b) { return a < b ? a : b; }
+            static mask gt(reg a, reg b) { return a > b; }
+            static mask lt(reg a, reg b) { return a < b; }
+            static reg select(mask m, reg a, reg b) { return m ? a : b; }
+            static reg abs(reg a) { return std::fabs(a); }
+            static reg copysign(reg mag, reg s) { return std::copysign(mag, s); }
+            // t = n + shifter keeps the integer n in its low mantissa bits; returns 2^(n - 1)
+            static reg half_pow2(reg t) {
+                Bits bits;
+                std::memcpy(&bits, &t, sizeof(T));
+                bits = (bits << MANTISSA) + (static_cast<Bits>(BIAS - 1) << MANTISSA);
+                T out;
+                std::memcpy(&out, &bits, sizeof(T));
+                return out;
+            }
+        };
+
+        using F32 = Scalar<float, uint32_t, 23, 127>;
+        using F64 = Scalar<double, uint64_t, 52, 1023>;
+
+#include "activation_kernels_impl.hpp"
+    }
+
+#ifdef ACT_KERNELS_X86
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+    namespace sse2 {
+
+        struct F32 {
+            using value_type = float;
+            using reg = __m128;
+            using mask = __m128;
+            static constexpr size_t width = 4;
+
+            static reg set1(float v) { return _mm_set1_ps(v); }
+            static reg load(const float* p) { return _mm_loadu_ps(p); }
+            static void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+            static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+            static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+            static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+            static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+            static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+            static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+            static mask gt(reg a, reg b) { return _mm_cmpgt_ps(a, b); }
+            static mask lt(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+            static reg select(mask m, reg a, reg b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+            static reg abs(reg a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+            static reg copysign(reg mag, reg s) { return _mm_or_ps(abs(mag), _mm_and_ps(_mm_set1_ps(-0.0f), s)); }
+            static reg half_pow2(reg t) {
+                __m128i bits = _mm_slli_epi32(_mm_castps_si128(t), 23);
+                return _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(126 << 23)));
+            }
+        };
+
+        struct F64 {
+            using value_type = double;
+            using reg = __m128d;
+            using mask = __m128d;
+            static constexpr size_t width = 2;
+
+            static reg set1(double v) { return _mm_set1_pd(v); }
+            static reg load(const double* p) { return _mm_loadu_pd(p); }
+            static void store(double* p, reg v) { _mm_storeu_pd(p, v); }
+            static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+            static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+            static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+            static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+            static reg max(reg a, reg b) { return _mm_max_pd(a, b); }
+            static reg min(reg a, reg b) { return _mm_min_pd(a, b); }
+            static mask gt(reg a, reg b) { return _mm_cmpgt_pd(a, b); }
+            static mask lt(reg a, reg b) { return _mm_cmplt_pd(a, b); }
+            static reg select(mask m, reg a, reg b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+            static reg abs(reg a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+            static reg copysign(reg mag, reg s) { return _mm_or_pd(abs(mag), _mm_and_pd(_mm_set1_pd(-0.0), s)); }
+            static reg half_pow2(reg t) {
+                __m128i bits = _mm_slli_epi64(_mm_castpd_si128(t), 52);
+                return _mm_castsi128_pd(_mm_add_epi64(bits, _mm_set1_epi64x(int64_t(1022) << 52)));
+            }
+        };
+
+#include "activation_kernels_impl.hpp"
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+    namespace avx2 {
+
+        struct F32 {
+            using value_type = float;
+            using reg = __m256;
+            using mask = __m256;
+            static constexpr size_t width = 8;
+
+            static reg set1(float v) { return _mm256_set1_ps(v); }
+            static reg load(const float* p) { return _mm256_loadu_ps(p); }
+            static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+            static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+            static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+            static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+            static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+            static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+            static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+            static mask gt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+            static mask lt(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+            static reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+            static reg abs(reg a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+            static reg copysign(reg mag, reg s) { return _mm256_or_ps(abs(mag), _mm256_and_ps(_mm256_set1_ps(-0.0f), s)); }
+            static reg half_pow2(reg t) {
+                __m256i bits = _mm256_slli_epi32(_mm256_castps_si256(t), 23);
+                return _mm256_castsi256_ps(_mm256_add_epi32(bits, _mm256_set1_epi32(126 << 23)));
+            }
+        };
+
+        struct F64 {
+            using value_type = double;
+            using reg = __m256d;
+            using mask = __m256d;
+            static constexpr size_t width = 4;
+
+            static reg set1(double v) { return _mm256_set1_pd(v); }
+            static reg load(const double* p) { return _mm256_loadu_pd(p); }
+            static void store(double* p, reg v) { _mm256_storeu_pd(p, v); }
+            static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+            static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+            static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+            static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+            static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+            static reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+            static mask gt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+            static mask lt(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+            static reg select(mask m, reg a, reg b) { return _mm256_blendv_pd(b, a, m); }
+            static reg abs(reg a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+            static reg copysign(reg mag, reg s) { return _mm256_or_pd(abs(mag), _mm256_and_pd(_mm256_set1_pd(-0.0), s)); }
+            static reg half_pow2(reg t) {
+                __m256i bits = _mm256_slli_epi64(_mm256_castpd_si256(t), 52);
+                return _mm256_castsi256_pd(_mm256_add_epi64(bits, _mm256_set1_epi64x(int64_t(1022) << 52)));
+            }
+        };
+
+#include "activation_kernels_impl.hpp"
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+// GCC 12 flags the _mm512_undefined_* placeholders inside its own intrinsic headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    namespace avx512 {
+
+        struct F32 {
+            using value_type = float;
+            using reg = __m512;
+            using mask = __mmask16;
+            static constexpr size_t width = 16;
+
+            static reg set1(float v) { return _mm512_set1_ps(v); }
+            static reg load(const float* p) { return _mm512_loadu_ps(p); }
+            static void store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+            static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+            static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+            static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+            static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+            static reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+            static reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+            static mask gt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+            static mask lt(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+            static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_ps(m, b, a); }
+            static reg abs(reg a) { return _mm512_castsi512_ps(_mm512_andnot_si512(_mm512_set1_epi32(INT32_MIN), _mm512_castps_si512(a))); }
+            static reg copysign(reg mag, reg s) {
+                __m512i sign = _mm512_and_si512(_mm512_set1_epi32(INT32_MIN), _mm512_castps_si512(s));
+                return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(abs(mag)), sign));
+            }
+            static reg half_pow2(reg t) {
+                __m512i bits = _mm512_slli_epi32(_mm512_castps_si512(t), 23);
+                return _mm512_castsi512_ps(_mm512_add_epi32(bits, _mm512_set1_epi32(126 << 23)));
+            }
+        };
+
+        struct F64 {
+            using value_type = double;
+            using reg = __m512d;
+            using mask = __mmask8;
+            static constexpr size_t width = 8;
+
+            static reg set1(double v) { return _mm512_set1_pd(v); }
+            static reg load(const double* p) { return _mm512_loadu_pd(p); }
+            static void store(double* p, reg v) { _mm512_storeu_pd(p, v); }
+            static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+            static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+            static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+            static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+            static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+            static reg max(reg a, reg b) { return _mm512_max_pd(a, b); }
+            static reg min(reg a, reg b) { return _mm512_min_pd(a, b); }
+            static mask gt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+            static mask lt(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+            static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_pd(m, b, a); }
+            static reg abs(reg a) { return _mm512_castsi512_pd(_mm512_andnot_si512(_mm512_set1_epi64(INT64_MIN), _mm512_castpd_si512(a))); }
+            static reg copysign(reg mag, reg s) {
+                __m512i sign = _mm512_and_si512(_mm512_set1_epi64(INT64_MIN), _mm512_castpd_si512(s));
+                return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(abs(mag)), sign));
+            }
+            static reg half_pow2(reg t) {
+                __m512i bits = _mm512_slli_epi64(_mm512_castpd_si512(t), 52);
+                return _mm512_castsi512_pd(_mm512_add_epi64(bits, _mm512_set1_epi64(int64_t(1022) << 52)));
+            }
+        };
+
+#include "activation_kernels_impl.hpp"
+    }
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+#endif
+
+    namespace detail {
+
+        // [isa][mode] tables, built once; indexing them per call keeps set_max_isa / set_math_mode live
+        template <typename T>
+        struct Dispatch {
+            Kernel_Table<T> tables[4][2];
+
+            Dispatch() {
+                for (int isa = 0; isa < 4; isa ++) {
+                    tables[isa][0] = generic::make_kernel_table<T, false>();
+                    tables[isa][1] = generic::make_kernel_table<T, true>();
+                }
+#ifdef ACT_KERNELS_X86
+                tables[1][0] = sse2::make_kernel_table<T, false>();
+                tables[1][1] = sse2::make_kernel_table<T, true>();
+                tables[2][0] = avx2::make_kernel_table<T, false>();
+                tables[2][1] = avx2::make_kernel_table<T, true>();
+                tables[3][0] = avx512::make_kernel_table<T, false>();
+                tables[3][1] = avx512::make_kernel_table<T, true>();
+#endif
+            }
+        };
+
+        template <typename T>
+        const Kernel_Table<T>& kernels() {
+            static const Dispatch<T> dispatch;
+            int isa = static_cast<int>(cpu_features::active_isa());
+            int mode = math_mode() == Math_Mode::Fast ? 1 : 0;
+            return dispatch.tables[isa][mode];
+        }
+
+        template <typename T>
+        constexpr bool has_kernels = std::is_same_v<T, float> || std::is_same_v<T, double>;
+    }
+
+    // Element types without a kernel (e.g long double) fall back to plain scalar loops.
+
+    template <typename T>
+    void exp(const T* x, T* y, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().exp(x, y, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                y[i] = std::exp(x[i]);
+            }
+        }
+    }
+
+    template <typename T>
+    void sigmoid_forward(const T* x, T* y, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().sigmoid_forward(x, y, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                y[i] = 1 / (1 + std::exp(-x[i]));
+            }
+        }
+    }
+
+    template <typename T>
+    void tanh_forward(const T* x, T* y, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().tanh_forward(x, y, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                y[i] = std::tanh(x[i]);
+            }
+        }
+    }
+
+    template <typename T>
+    void relu_forward(const T* x, T* y, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().relu_forward(x, y, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                y[i] = x[i] >= 0 ? x[i] : 0;
+            }
+        }
+    }
+
+    // dx = sigmoid'(.) * dy, written in terms of the saved output y
+    template <typename T>
+    void sigmoid_backward(const T* y, const T* dy, T* dx, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().sigmoid_backward(y, dy, dx, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                dx[i] = y[i] * (1 - y[i]) * dy[i];
+            }
+        }
+    }
+
+    template <typename T>
+    void tanh_backward(const T* y, const T* dy, T* dx, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().tanh_backward(y, dy, dx, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                dx[i] = (1 - y[i] * y[i]) * dy[i];
+            }
+        }
+    }
+
+    template <typename T>
+    void relu_backward(const T* y, const T* dy, T* dx, size_t n) {
+        if constexpr (detail::has_kernels<T>) {
+            detail::kernels<T>().relu_backward(y, dy, dx, n);
+        }
+        else {
+            for (size_t i = 0; i < n; i ++) {
+                dx[i] = y[i] > 0 ? dy[i] : 0;
+            }
+        }
+    }
+
+    // activation selected at runtime, e.g by a fused linear + activation layer
+    enum class Activation { Identity, ReLU, Sigmoid, Tanh };
+
+    template <typename T>
+    void activation_forward(Activation activation, const T* x, T* y, size_t n) {
+        switch (activation) {
+            case Activation::ReLU: act_kernels::relu_forward<T>(x, y, n); break;
+            case Activation::Sigmoid: act_kernels::sigmoid_forward<T>(x, y, n); break;
+            case Activation::Tanh: act_kernels::tanh_forward<T>(x, y, n); break;
+            default:
+                if (x != y) {
+                    std::copy(x, x + n, y);
+                }
+        }
+    }
+
+    template <typename T>
+    void activation_backward(Activation activation, const T* y, const T* dy, T* dx, size_t n) {
+        switch (activation) {
+            case Activation::ReLU: act_kernels::relu_backward<T>(y, dy, dx, n); break;
+            case Activation::Sigmoid: act_kernels::sigmoid_backward<T>(y, dy, dx, n); break;
+            case Activation::Tanh: act_kernels::tanh_backward<T>(y, dy, dx, n); break;
+            default:
+                if (dy != dx) {
+                    std::copy(dy, dy + n, dx);
+                }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,241 @@
+// Kernel bodies shared by every ISA. activation_kernels.hpp includes this file once per ISA,
+// inside a namespace that defines the vector wrappers F32 / F64 and under the matching
+// "#pragma GCC target", so there is deliberately no include guard here.
+//
+// A wrapper V provides: value_type, reg, mask, width, set1, load, store, add, sub, mul, div,
+// fmadd (a * b + c), max / min (returning the second operand on NaN, like MAXPS), gt, lt,
+// select (mask ? a : b), abs, copysign and half_pow2 (see below).
+
+template <typename T>
+struct Vec_Of;
+
+template <>
+struct Vec_Of<float> {
+    using type = F32;
+};
+
+template <>
+struct Vec_Of<double> {
+    using type = F64;
+};
+
+// exp(x) = 2^n * exp(r), n = round(x / ln2), r = x - n * ln2 split in two parts (Cody-Waite) so
+// that r is exact. 2^n is built from the exponent bits as 2^(n - 1) * 2, which keeps n = max
+// representable and lets tiny results come out as subnormals instead of garbage.
+template <typename V, bool FAST>
+inline typename V::reg exp_v(typename V::reg x) {
+    using T = typename V::value_type;
+    using C = Exp_Constants<T>;
+    using reg = typename V::reg;
+
+    reg xc = V::min(V::set1(C::hi), V::max(V::set1(C::lo), x));
+    reg t = V::fmadd(xc, V::set1(C::log2e), V::set1(C::shifter));
+    reg n = V::sub(t, V::set1(C::shifter));
+    reg r = V::fmadd(n, V::set1(-C::ln2_hi), xc);
+    r = V::fmadd(n, V::set1(-C::ln2_lo), r);
+
+    const T* coeffs = FAST ? C::fast : C::precise;
+    const size_t degree = FAST ? C::fast_degree : C::precise_degree;
+    // Horner on exp(r) = 1 + r + r^2 * (c[0] + c[1] r + ...), coefficients stored highest first
+    reg p = V::set1(coeffs[0]);
+    for (size_t i = 1; i + 1 < degree; i ++) {
+        p = V::fmadd(p, r, V::set1(coeffs[i]));
+    }
+    reg r2 = V::mul(r, r);
+    p = V::fmadd(p, r2, V::add(r, V::set1(static_cast<T>(1))));
+
+    reg res = V::mul(V::mul(p, V::half_pow2(t)), V::set1(static_cast<T>(2)));
+    res = V::select(V::gt(x, V::set1(C::hi)), V::set1(C::inf()), res);
+    res = V::select(V::lt(x, V::set1(C::lo)), V::set1(static_cast<T>(0)), res);
+    return res;
+}
+
+template <typename V, bool FAST>
+inline typename V::reg sigmoid_v(typename V::reg x) {
+    using T = typename V::value_type;
+    const typename V::reg one = V::set1(static_cast<T>(1));
+    return V::div(one, V::add(one, exp_v<V, FAST>(V::sub(V::set1(static_cast<T>(0)), x))));
+}
+
+// Cephes tanhf / tanh for |x| < 0.625: x + x z P(z) (float) and x + x z P(z) / Q(z) (double), z = x^2
+template <typename V>
+inline typename V::reg tanh_small_v(typename V::reg x, typename V::reg z) {
+    using T = typename V::value_type;
+    using reg = typename V::reg;
+    if constexpr (std::is_same_v<T, float>) {
+        reg p = V::set1(-5.70498872745E-3f);
+        p = V::fmadd(p, z, V::set1(2.06390887954E-2f));
+        p = V::fmadd(p, z, V::set1(-5.37397155531E-2f));
+        p = V::fmadd(p, z, V::set1(1.33314422036E-1f));
+        p = V::fmadd(p, z, V::set1(-3.33332819422E-1f));
+        return V::fmadd(V::mul(x, z), p, x);
+    }
+    else {
+        reg p = V::set1(-9.64399179425052238628E-1);
+        p = V::fmadd(p, z, V::set1(-9.92877231001918586564E1));
+        p = V::fmadd(p, z, V::set1(-1.61468768441708447952E3));
+        reg q = V::add(z, V::set1(1.12811678491632931402E2));
+        q = V::fmadd(q, z, V::set1(2.23548839060100448583E3));
+        q = V::fmadd(q, z, V::set1(4.84406305325125486048E3));
+        return V::fmadd(V::mul(x, z), V::div(p, q), x);
+    }
+}
+
+// tanh(|x|) = 1 - 2 / (exp(2|x|) + 1). That form cancels badly near zero, so the precise mode
+// switches to the Cephes odd polynomial / rational approximation below |x| = 0.625.
+template <typename V, bool FAST>
+inline typename V::reg tanh_v(typename V::reg x) {
+    using T = typename V::value_type;
+    using reg = typename V::reg;
+    const reg one = V::set1(static_cast<T>(1));
+    const reg two = V::set1(static_cast<T>(2));
+    reg a = V::abs(x);
+    reg e = exp_v<V, FAST>(V::mul(two, a));
+    reg large = V::copysign(V::sub(one, V::div(two, V::add(e, one))), x);
+    if (FAST) {
+        return large;
+    }
+    reg z = V::mul(x, x);
+    reg small = tanh_small_v<V>(x, z);
+    return V::select(V::lt(a, V::set1(static_cast<T>(0.625))), small, large);
+}
+
+template <typename V>
+inline typename V::reg relu_v(typename V::reg x) {
+    return V::max(x, V::set1(static_cast<typename V::value_type>(0)));
+}
+
+// y = Op::apply(x) over n elements; the tail runs through a padded scratch vector so every
+// element takes exactly the same code path. Ops are structs rather than lambdas because a
+// lambda body does not pick up the enclosing "#pragma GCC target".
+template <typename V, typename Op>
+inline void map_unary(const typename V::value_type* x, typename V::value_type* y, size_t n) {
+    using T = typename V::value_type;
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(y + i, Op::apply(V::load(x + i)));
+    }
+    if (i < n) {
+        T in[V::width] = {};
+        T out[V::width];
+        std::copy(x + i, x + n, in);
+        V::store(out, Op::apply(V::load(in)));
+        std::copy(out, out + (n - i), y + i);
+    }
+}
+
+template <typename V, typename Op>
+inline void map_binary(const typename V::value_type* a, const typename V::value_type* b, typename V::value_type* y, size_t n) {
+    using T = typename V::value_type;
+    size_t i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(y + i, Op::apply(V::load(a + i), V::load(b + i)));
+    }
+    if (i < n) {
+        T in_a[V::width] = {};
+        T in_b[V::width] = {};
+        T out[V::width];
+        std::copy(a + i, a + n, in_a);
+        std::copy(b + i, b + n, in_b);
+        V::store(out, Op::apply(V::load(in_a), V::load(in_b)));
+        std::copy(out, out + (n - i), y + i);
+    }
+}
+
+template <typename V, bool FAST>
+struct Exp_Op {
+    static typename V::reg apply(typename V::reg x) { return exp_v<V, FAST>(x); }
+};
+
+template <typename V, bool FAST>
+struct Sigmoid_Op {
+    static typename V::reg apply(typename V::reg x) { return sigmoid_v<V, FAST>(x); }
+};
+
+template <typename V, bool FAST>
+struct Tanh_Op {
+    static typename V::reg apply(typename V::reg x) { return tanh_v<V, FAST>(x); }
+};
+
+template <typename V>
+struct Relu_Op {
+    static typename V::reg apply(typename V::reg x) { return relu_v<V>(x); }
+};
+
+// the derivative ops take the saved activation output y and the incoming gradient dy
+template <typename V>
+struct Sigmoid_Grad_Op {
+    static typename V::reg apply(typename V::reg y, typename V::reg dy) {
+        return V::mul(V::mul(y, V::sub(V::set1(static_cast<typename V::value_type>(1)), y)), dy);
+    }
+};
+
+template <typename V>
+struct Tanh_Grad_Op {
+    static typename V::reg apply(typename V::reg y, typename V::reg dy) {
+        return V::mul(V::sub(V::set1(static_cast<typename V::value_type>(1)), V::mul(y, y)), dy);
+    }
+};
+
+template <typename V>
+struct Relu_Grad_Op {
+    static typename V::reg apply(typename V::reg y, typename V::reg dy) {
+        const typename V::reg zero = V::set1(static_cast<typename V::value_type>(0));
+        return V::select(V::gt(y, zero), dy, zero);
+    }
+};
+
+template <typename T, bool FAST>
+void exp_kernel(const T* x, T* y, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_unary<V, Exp_Op<V, FAST>>(x, y, n);
+}
+
+template <typename T, bool FAST>
+void sigmoid_forward_kernel(const T* x, T* y, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_unary<V, Sigmoid_Op<V, FAST>>(x, y, n);
+}
+
+template <typename T, bool FAST>
+void tanh_forward_kernel(const T* x, T* y, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_unary<V, Tanh_Op<V, FAST>>(x, y, n);
+}
+
+template <typename T>
+void relu_forward_kernel(const T* x, T* y, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_unary<V, Relu_Op<V>>(x, y, n);
+}
+
+template <typename T>
+void sigmoid_backward_kernel(const T* y, const T* dy, T* dx, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_binary<V, Sigmoid_Grad_Op<V>>(y, dy, dx, n);
+}
+
+template <typename T>
+void tanh_backward_kernel(const T* y, const T* dy, T* dx, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_binary<V, Tanh_Grad_Op<V>>(y, dy, dx, n);
+}
+
+template <typename T>
+void relu_backward_kernel(const T* y, const T* dy, T* dx, size_t n) {
+    using V = typename Vec_Of<T>::type;
+    map_binary<V, Relu_Grad_Op<V>>(y, dy, dx, n);
+}
+
+template <typename T, bool FAST>
+Kernel_Table<T> make_kernel_table() {
+    Kernel_Table<T> table;
+    table.exp = &exp_kernel<T, FAST>;
+    table.sigmoid_forward = &sigmoid_forward_kernel<T, FAST>;
+    table.tanh_forward = &tanh_forward_kernel<T, FAST>;
+    table.relu_forward = &relu_forward_kernel<T>;
+    table.sigmoid_backward = &sigmoid_backward_kernel<T>;
+    table.tanh_backward = &tanh_backward_kernel<T>;
+    table.relu_backward = &relu_backward_kernel<T>;
+    return table;
+}
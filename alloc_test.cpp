@@ -0,0 +1,111 @@
+#include "nn.hpp"
+#include "optimizer.hpp"
+#include "gradient_accumulation.hpp"
+#include <cstdio>
+#include <functional>
+
+// Checks with tensor::allocation_count() that training and inference reach a steady state: the
+// first step sizes the gradients, the optimizer state and the workspace, and every step from then
+// on (forward, backward, optimizer step) allocates nothing. A workspace that had to grow during the
+// first step is coalesced into one block by the reset of the second, so without reserve_workspace()
+// the steady state starts at the third step; with it, at the second.
+// Prints the allocations of each step and exits non-zero on failure.
+
+// steps from `steady` on (counting from 0) must not allocate
+static bool check(const char* name, size_t steady, const std::function<void()>& step) {
+    const size_t steps = 5;
+    size_t counts[steps];
+    for (size_t s = 0; s < steps; s ++) {
+        const size_t before = tensor::allocation_count();
+        step();
+        counts[s] = tensor::allocation_count() - before;
+    }
+    bool ok = true;
+    for (size_t s = steady; s < steps; s ++) {
+        ok = ok && counts[s] == 0;
+    }
+    std::printf("%-28s allocations per step:", name);
+    for (size_t s = 0; s < steps; s ++) {
+        std::printf(" %zu", counts[s]);
+    }
+    std::printf(": %s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main() {
+    const size_t rows = 128;
+    const std::string architecture = "linear-relu-linear-relu-linear-relu-linear";
+    const std::valarray<int> dims = {64, 256, 256, 256, 10};
+    tensor::Tensor<float> x = ops_utils::init_matrix::generate_uniform_matrix<float>(rows, 64);
+    tensor::Tensor<float> labels(rows, 1);
+    for (size_t i = 0; i < rows; i ++) {
+        labels(i, 0) = static_cast<float>(i % 10);
+    }
+    bool ok = true;
+
+    neural_network::Neural_Network<float> sgd_model(architecture, dims);
+    Optimizer::Gradient_Descent<float> sgd(sgd_model.learnable_layers(), 0.01f);
+    ok = check("SGD over the layers", 2, [&] {
+        sgd_model.zero_grad();
+        sgd_model.forward(x, labels);
+        sgd_model.backward();
+        sgd.step();
+    }) && ok;
+
+    neural_network::Neural_Network<float> adam_model(architecture, dims);
+    Optimizer::Adam<float> adam(adam_model.parameter_arena(), 0.001f);
+    ok = check("Adam over the arena", 2, [&] {
+        adam.zero_grad();
+        adam_model.forward(x, labels);
+        adam_model.backward();
+        adam.step();
+    }) && ok;
+
+    neural_network::Neural_Network<float> checkpointed(architecture, dims);
+    checkpointed.set_checkpoints({0, 1, 2});
+    Optimizer::Momentum_SGD<float> momentum(checkpointed.parameter_arena(), 0.01f);
+    ok = check("Momentum, checkpointed", 2, [&] {
+        momentum.zero_grad();
+        checkpointed.forward(x, labels);
+        checkpointed.backward();
+        momentum.step();
+    }) && ok;
+
+    neural_network::Neural_Network<float> accumulated(architecture, dims);
+    Optimizer::Gradient_Descent<float> accumulated_sgd(accumulated.parameter_arena(), 0.01f);
+    neural_network::Accumulation_Options options;
+    options.logical_batch_size = rows;
+    options.memory_budget = size_t(1) << 18;
+    neural_network::Accumulating_Trainer<float> trainer(accumulated, accumulated_sgd, options);
+    ok = check("Accumulating_Trainer", 1, [&] {
+        trainer.train_step(x, labels);
+    }) && ok;
+
+    // sized from a step of sgd_model, so even the first forward runs in the reserved workspace
+    neural_network::Neural_Network<float> reserved(architecture, dims);
+    reserved.set_checkpoints({0, 2});
+    sgd_model.set_checkpoints({0, 2});
+    sgd_model.zero_grad();
+    sgd_model.forward(x, labels);
+    sgd_model.backward();
+    reserved.reserve_workspace(sgd_model.step_workspace_bytes());
+    Optimizer::Gradient_Descent<float> reserved_sgd(reserved.learnable_layers(), 0.01f);
+    const size_t before_forward = tensor::allocation_count();
+    reserved.forward(x, labels);
+    const bool forward_ok = tensor::allocation_count() == before_forward;
+    std::printf("%-28s allocations in the first forward: %zu: %s\n", "reserved, checkpointed", tensor::allocation_count() - before_forward, forward_ok ? "OK" : "FAILED");
+    ok = forward_ok && ok;
+    ok = check("reserved, checkpointed", 1, [&] {
+        reserved.zero_grad();
+        reserved.forward(x, labels);
+        reserved.backward();
+        reserved_sgd.step();
+    }) && ok;
+
+    neural_network::Inference_Buffers<float> buffers;
+    ok = check("infer_logits", 1, [&] {
+        sgd_model.infer_logits(x, buffers);
+    }) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#ifndef BFLOAT16_H
+#define BFLOAT16_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace tensor {
+
+    // bfloat16 is the upper half of an IEEE float32: the same exponent range with 8 significant
+    // bits. It is only a storage format here, e.g for weights that are streamed on every forward;
+    // values are widened to float (exactly) before any arithmetic.
+    struct bfloat16 {
+        uint16_t bits;
+
+        bfloat16() = default;
+        explicit bfloat16(float value) : bits(bfloat16::round(value)) {}
+
+        explicit operator float() const {
+            uint32_t u = static_cast<uint32_t>(this->bits) << 16;
+            float value;
+            std::memcpy(&value, &u, sizeof(value));
+            return value;
+        }
+
+        // round to nearest even; NaNs stay (quiet) NaNs
+        static uint16_t round(float value) {
+            uint32_t u;
+            std::memcpy(&u, &value, sizeof(u));
+            if ((u & 0x7fffffffu) > 0x7f800000u) {
+                return static_cast<uint16_t>((u >> 16) | 0x0040u);
+            }
+            u += 0x7fffu + ((u >> 16) & 1u);
+            return static_cast<uint16_t>(u >> 16);
+        }
+    };
+    static_assert(sizeof(bfloat16) == 2, "bfloat16 must stay 2 bytes.");
+
+    // whole-range conversions, plain loops so the compiler vectorizes them
+    inline void to_bfloat16(const float* src, bfloat16* dst, size_t n) {
+        for (size_t i = 0; i < n; i ++) {
+            dst[i] = bfloat16(src[i]);
+        }
+    }
+
+    inline void to_float(const bfloat16* src, float* dst, size_t n) {
+        for (size_t i = 0; i < n; i ++) {
+            dst[i] = static_cast<float>(src[i]);
+        }
+    }
+}
+
+#endif
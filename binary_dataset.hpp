@@ -0,0 +1,240 @@
+#ifndef BINARY_DATASET_H
+#define BINARY_DATASET_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+
+#include "tensor.hpp"
+#include "mapped_file.hpp"
+#include "data_utils.hpp"
+
+// On-disk dataset that is used in place through mmap instead of being parsed.
+//
+//   [Binary_Header, 64 bytes][column names, '\0'-terminated, features first then the label]
+//   [features, rows x num_features, row-major, 64-byte aligned][labels, rows, 64-byte aligned]
+//
+// The features are stored row by row so that any run of consecutive samples is one contiguous
+// view; the labels form a separate block. Values are little-endian float32 or float64.
+namespace data_utils {
+
+    using tensor::Dtype;
+    using tensor::dtype_of;
+
+    struct Binary_Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t dtype;
+        uint64_t rows;
+        uint64_t num_features;
+        uint64_t names_offset;
+        uint64_t features_offset;
+        uint64_t labels_offset;
+        uint32_t endian_check;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Binary_Header) == 64, "Header must stay 64 bytes.");
+
+    namespace detail {
+        constexpr char BINARY_MAGIC[8] = {'N', 'N', 'D', 'A', 'T', 'A', '\0', '\0'};
+        constexpr uint32_t BINARY_VERSION = 1;
+        constexpr uint32_t ENDIAN_CHECK = 0x01020304;
+
+        inline uint64_t align_up(uint64_t offset) {
+            return (offset + tensor::ALIGNMENT - 1) / tensor::ALIGNMENT * tensor::ALIGNMENT;
+        }
+
+        inline void write_bytes(std::FILE* f, const void* data, size_t bytes, const std::string& file_name) {
+            if (bytes > 0 && std::fwrite(data, 1, bytes, f) != bytes) {
+                std::fclose(f);
+                throw std::runtime_error("Unable to write file: " + file_name);
+            }
+        }
+
+        inline void write_padding(std::FILE* f, uint64_t& offset, uint64_t target, const std::string& file_name) {
+            static const char zeros[tensor::ALIGNMENT] = {};
+            detail::write_bytes(f, zeros, target - offset, file_name);
+            offset = target;
+        }
+
+        inline std::vector<std::string> default_column_names(size_t num_features) {
+            std::vector<std::string> names;
+            for (size_t j = 0; j < num_features; j ++) {
+                names.push_back("f" + std::to_string(j));
+            }
+            names.push_back("label");
+            return names;
+        }
+    }
+
+    // writes a dataset in the binary format; column_names holds the feature names followed by the
+    // label name, or is empty for f0, f1, ..., label
+    template <typename T>
+    void save_binary(const Dataset<T>& data, const std::string& file_name, std::vector<std::string> column_names = {}) {
+        if (column_names.empty()) {
+            column_names = detail::default_column_names(data.num_features());
+        }
+        if (column_names.size() != data.num_features() + 1) {
+            throw std::invalid_argument("Expected one name per feature plus one for the label.");
+        }
+
+        Binary_Header header = {};
+        std::memcpy(header.magic, detail::BINARY_MAGIC, sizeof(header.magic));
+        header.version = detail::BINARY_VERSION;
+        header.dtype = static_cast<uint32_t>(dtype_of<T>());
+        header.rows = data.rows();
+        header.num_features = data.num_features();
+        header.names_offset = sizeof(Binary_Header);
+        uint64_t names_bytes = 0;
+        for (const std::string& name : column_names) {
+            names_bytes += name.size() + 1;
+        }
+        header.features_offset = detail::align_up(header.names_offset + names_bytes);
+        header.labels_offset = detail::align_up(header.features_offset + header.rows * header.num_features * sizeof(T));
+        header.endian_check = detail::ENDIAN_CHECK;
+
+        std::FILE* f = std::fopen(file_name.c_str(), "wb");
+        if (f == nullptr) {
+            throw std::runtime_error("Unable to create file: " + file_name);
+        }
+        uint64_t offset = 0;
+        detail::write_bytes(f, &header, sizeof(header), file_name);
+        offset += sizeof(header);
+        for (const std::string& name : column_names) {
+            detail::write_bytes(f, name.c_str(), name.size() + 1, file_name);
+            offset += name.size() + 1;
+        }
+        detail::write_padding(f, offset, header.features_offset, file_name);
+        detail::write_bytes(f, data.features.data(), data.features.size() * sizeof(T), file_name);
+        offset += data.features.size() * sizeof(T);
+        detail::write_padding(f, offset, header.labels_offset, file_name);
+        detail::write_bytes(f, data.labels.data(), data.labels.size() * sizeof(T), file_name);
+        if (std::fclose(f) != 0) {
+            throw std::runtime_error("Unable to write file: " + file_name);
+        }
+    }
+
+    // one-time conversion; with skip_lines > 0 the first skipped line supplies the column names
+    template <typename T>
+    void csv_to_binary(const std::string& csv_file, const std::string& binary_file, const Csv_Options& options = Csv_Options()) {
+        Dataset<T> data = data_utils::load_csv<T>(csv_file, options);
+        std::vector<std::string> names;
+        if (options.skip_lines > 0) {
+            io::Mapped_File file(csv_file);
+            const char* p = file.data();
+            const char* end = p + file.size();
+            if (end - p >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+                p += 3;
+            }
+            const char* e = data_utils::detail::line_end(p, end);
+            if (e > p && e[-1] == '\r') {
+                e --;
+            }
+            std::string field;
+            for (; p <= e; p ++) {
+                if (p == e || *p == options.delimiter) {
+                    names.push_back(field);
+                    field.clear();
+                }
+                else {
+                    field.push_back(*p);
+                }
+            }
+            if (names.size() != data.num_features() + 1) {
+                names.clear();
+            }
+            else if (!options.last_label) {
+                // stored as features first, label last
+                std::rotate(names.begin(), names.begin() + 1, names.end());
+            }
+        }
+        data_utils::save_binary<T>(data, binary_file, names);
+    }
+
+    // Read-only dataset mapped straight from a file written by save_binary. Nothing is parsed or
+    // copied: features(), labels() and batch() are views into the mapping, backed by the page cache
+    // and shared by every process that maps the same file.
+    template <typename T>
+    class Binary_Dataset {
+    private:
+        io::Mapped_File file;
+        Binary_Header header = {};
+        std::vector<std::string> names;
+
+    public:
+        explicit Binary_Dataset(const std::string& file_name) : file(file_name) {
+            if (this->file.size() < sizeof(Binary_Header)) {
+                throw std::runtime_error("Not a binary dataset: " + file_name);
+            }
+            std::memcpy(&this->header, this->file.data(), sizeof(Binary_Header));
+            if (std::memcmp(this->header.magic, detail::BINARY_MAGIC, sizeof(this->header.magic)) != 0 || this->header.endian_check != detail::ENDIAN_CHECK) {
+                throw std::runtime_error("Not a binary dataset: " + file_name);
+            }
+            if (this->header.version != detail::BINARY_VERSION) {
+                throw std::runtime_error("Unsupported binary dataset version " + std::to_string(this->header.version) + ": " + file_name);
+            }
+            if (this->header.dtype != static_cast<uint32_t>(dtype_of<T>())) {
+                throw std::runtime_error("Binary dataset dtype does not match the requested element type: " + file_name);
+            }
+            const uint64_t labels_end = this->header.labels_offset + this->header.rows * sizeof(T);
+            if (this->header.features_offset % tensor::ALIGNMENT != 0 || this->header.labels_offset % tensor::ALIGNMENT != 0 || labels_end > this->file.size()
+                || this->header.features_offset + this->header.rows * this->header.num_features * sizeof(T) > this->header.labels_offset) {
+                throw std::runtime_error("Truncated or corrupt binary dataset: " + file_name);
+            }
+
+            const char* p = this->file.data() + this->header.names_offset;
+            const char* end = this->file.data() + this->header.features_offset;
+            for (size_t j = 0; j <= this->header.num_features && p < end; j ++) {
+                size_t len = strnlen(p, static_cast<size_t>(end - p));
+                this->names.emplace_back(p, len);
+                p += len + 1;
+            }
+        }
+
+        size_t rows() const {
+            return this->header.rows;
+        }
+        size_t num_features() const {
+            return this->header.num_features;
+        }
+        // feature names followed by the label name
+        const std::vector<std::string>& column_names() const {
+            return this->names;
+        }
+
+        tensor::Tensor_View<const T> features() const {
+            const T* data = reinterpret_cast<const T*>(this->file.data() + this->header.features_offset);
+            return tensor::Tensor_View<const T>(data, this->header.rows, this->header.num_features);
+        }
+        tensor::Tensor_View<const T> labels() const {
+            const T* data = reinterpret_cast<const T*>(this->file.data() + this->header.labels_offset);
+            return tensor::Tensor_View<const T>(data, this->header.rows, 1);
+        }
+
+        // samples [begin, begin + count) as (features, labels) views
+        std::pair<tensor::Tensor_View<const T>, tensor::Tensor_View<const T>> batch(size_t begin, size_t count) const {
+            return std::make_pair(this->features().slice_rows(begin, count), this->labels().slice_rows(begin, count));
+        }
+
+        // for shuffled access, so the kernel stops reading ahead
+        void advise_random() const {
+            this->file.advise_random();
+        }
+
+        // owning copy, e.g to keep the data after the file goes away
+        Dataset<T> to_dataset() const {
+            Dataset<T> data;
+            data.features = tensor::Tensor<T>(this->features());
+            data.labels = tensor::Tensor<T>(this->labels());
+            return data;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <valarray>
+#include <stdexcept>
+#include <limits>
+
+#include "tensor.hpp"
+#include "mapped_file.hpp"
+#include "nn.hpp"
+
+// Model checkpoint: everything needed to rebuild a Neural_Network, laid out so that the
+// parameters can be used straight from a memory mapping.
+//
+//   [Checkpoint_Header, 64 bytes][architecture string, no terminator]
+//   [num_dims, int64 each, 8-byte aligned][tensor table, Tensor_Entry each, 8-byte aligned]
+//   [W and b of every linear block in forward order, row-major, each 64-byte aligned]
+//
+// Values are little-endian float32 or float64.
+namespace neural_network {
+
+    struct Checkpoint_Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t dtype;
+        uint64_t architecture_bytes;
+        uint64_t dims_offset;
+        uint64_t num_dims;
+        uint64_t table_offset;
+        uint64_t num_tensors;
+        uint32_t endian_check;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Checkpoint_Header) == 64, "Header must stay 64 bytes.");
+
+    struct Tensor_Entry {
+        uint64_t rows;
+        uint64_t cols;
+        uint64_t offset;
+    };
+
+    namespace detail {
+        constexpr char CHECKPOINT_MAGIC[8] = {'N', 'N', 'M', 'O', 'D', 'E', 'L', '\0'};
+        constexpr uint32_t CHECKPOINT_VERSION = 1;
+        constexpr uint32_t ENDIAN_CHECK = 0x01020304;
+
+        inline uint64_t align_to(uint64_t offset, uint64_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        inline void write_at(std::FILE* f, uint64_t& offset, uint64_t target, const void* data, size_t bytes, const std::string& file_name) {
+            static const char zeros[tensor::ALIGNMENT] = {};
+            if ((target > offset && std::fwrite(zeros, 1, target - offset, f) != target - offset) || (bytes > 0 && std::fwrite(data, 1, bytes, f) != bytes)) {
+                std::fclose(f);
+                throw std::runtime_error("Unable to write file: " + file_name);
+            }
+            offset = target + bytes;
+        }
+    }
+
+    template <typename T>
+    void save_checkpoint(const Neural_Network<T>& model, const std::string& file_name) {
+        const std::string architecture = model.get_architecture();
+        const std::valarray<int>& dims = model.get_num_dims();
+        std::vector<const tensor::Tensor<T>*> tensors;
+        // bfloat16 weights are stored widened, which is exact
+        std::vector<tensor::Tensor<T>> widened;
+        widened.reserve(model.learnable_layers().size());
+        for (const auto* layer : model.learnable_layers()) {
+            // int8 weights are derived from the float model, which is what gets saved
+            if (layer->has_int8_weights()) {
+                throw std::invalid_argument("An int8 model cannot be checkpointed; save the float model and quantize it after loading.");
+            }
+            if (layer->has_bf16_weights()) {
+                const tensor::Tensor<tensor::bfloat16>& w = layer->get_W_bf16();
+                widened.emplace_back(w.rows(), w.cols());
+                for (size_t i = 0; i < w.size(); i ++) {
+                    widened.back()[i] = static_cast<T>(static_cast<float>(w[i]));
+                }
+                tensors.push_back(&widened.back());
+            }
+            else {
+                tensors.push_back(&layer->get_W());
+            }
+            tensors.push_back(&layer->get_b());
+        }
+
+        Checkpoint_Header header = {};
+        std::memcpy(header.magic, detail::CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.version = detail::CHECKPOINT_VERSION;
+        header.dtype = static_cast<uint32_t>(tensor::dtype_of<T>());
+        header.architecture_bytes = architecture.size();
+        header.dims_offset = detail::align_to(sizeof(Checkpoint_Header) + architecture.size(), 8);
+        header.num_dims = dims.size();
+        header.table_offset = header.dims_offset + dims.size() * sizeof(int64_t);
+        header.num_tensors = tensors.size();
+        header.endian_check = detail::ENDIAN_CHECK;
+
+        std::vector<int64_t> dims64(dims.size());
+        for (size_t i = 0; i < dims.size(); i ++) {
+            dims64[i] = dims[i];
+        }
+        std::vector<Tensor_Entry> table(tensors.size());
+        uint64_t end = header.table_offset + tensors.size() * sizeof(Tensor_Entry);
+        for (size_t i = 0; i < tensors.size(); i ++) {
+            table[i].rows = tensors[i]->rows();
+            table[i].cols = tensors[i]->cols();
+            table[i].offset = detail::align_to(end, tensor::ALIGNMENT);
+            end = table[i].offset + tensors[i]->size() * sizeof(T);
+        }
+
+        std::FILE* f = std::fopen(file_name.c_str(), "wb");
+        if (f == nullptr) {
+            throw std::runtime_error("Unable to create file: " + file_name);
+        }
+        uint64_t offset = 0;
+        detail::write_at(f, offset, 0, &header, sizeof(header), file_name);
+        detail::write_at(f, offset, offset, architecture.data(), architecture.size(), file_name);
+        detail::write_at(f, offset, header.dims_offset, dims64.data(), dims64.size() * sizeof(int64_t), file_name);
+        detail::write_at(f, offset, header.table_offset, table.data(), table.size() * sizeof(Tensor_Entry), file_name);
+        for (size_t i = 0; i < tensors.size(); i ++) {
+            detail::write_at(f, offset, table[i].offset, tensors[i]->data(), tensors[i]->size() * sizeof(T), file_name);
+        }
+        if (std::fclose(f) != 0) {
+            throw std::runtime_error("Unable to write file: " + file_name);
+        }
+    }
+
+    enum class Load_Mode {
+        // parameters are used in place from a private copy-on-write mapping: loading reads the
+        // header only, pages fault in as the first forward touches them, and training still works
+        // (a written page becomes a private copy, the file is never modified)
+        Map,
+        // parameters are copied into owned tensors and the file is closed again
+        Copy
+    };
+
+    // a network rebuilt from a checkpoint, together with the mapping its parameters may live in
+    template <typename T>
+    class Loaded_Model {
+    private:
+        // declared first so it outlives the network borrowing from it
+        io::Mapped_File file;
+        std::unique_ptr<Neural_Network<T>> model;
+
+    public:
+        Loaded_Model(const std::string& file_name, Load_Mode mode = Load_Mode::Map) : file(file_name, io::Access::Copy_On_Write) {
+            Checkpoint_Header header = {};
+            if (this->file.size() < sizeof(Checkpoint_Header)) {
+                throw std::runtime_error("Not a model checkpoint: " + file_name);
+            }
+            std::memcpy(&header, this->file.data(), sizeof(Checkpoint_Header));
+            if (std::memcmp(header.magic, detail::CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.endian_check != detail::ENDIAN_CHECK) {
+                throw std::runtime_error("Not a model checkpoint: " + file_name);
+            }
+            if (header.version != detail::CHECKPOINT_VERSION) {
+                throw std::runtime_error("Unsupported checkpoint version " + std::to_string(header.version) + ": " + file_name);
+            }
+            if (header.dtype != static_cast<uint32_t>(tensor::dtype_of<T>())) {
+                throw std::runtime_error("Checkpoint dtype does not match the requested element type: " + file_name);
+            }
+            if (sizeof(Checkpoint_Header) + header.architecture_bytes > header.dims_offset || header.dims_offset % 8 != 0
+                || header.dims_offset + header.num_dims * sizeof(int64_t) > header.table_offset || header.table_offset % 8 != 0
+                || header.table_offset + header.num_tensors * sizeof(Tensor_Entry) > this->file.size()) {
+                throw std::runtime_error("Truncated or corrupt checkpoint: " + file_name);
+            }
+
+            const char* base = this->file.data();
+            std::string architecture(base + sizeof(Checkpoint_Header), header.architecture_bytes);
+            std::valarray<int> dims(header.num_dims);
+            for (size_t i = 0; i < header.num_dims; i ++) {
+                int64_t d;
+                std::memcpy(&d, base + header.dims_offset + i * sizeof(int64_t), sizeof(int64_t));
+                if (d <= 0 || d > std::numeric_limits<int>::max()) {
+                    throw std::runtime_error("Truncated or corrupt checkpoint: " + file_name);
+                }
+                dims[i] = static_cast<int>(d);
+            }
+            // the network checks the dims against the architecture before building any layer
+            try {
+                this->model = std::make_unique<Neural_Network<T>>(architecture, dims, false);
+            } catch (const std::invalid_argument&) {
+                throw std::runtime_error("Checkpoint dimensions do not match its architecture: " + file_name);
+            }
+
+            std::vector<Block::Layer::Linear_Layer<T>*> layers = this->model->learnable_layers();
+            if (header.num_tensors != 2 * layers.size()) {
+                throw std::runtime_error("Checkpoint parameters do not match its architecture: " + file_name);
+            }
+            for (size_t l = 0; l < layers.size(); l ++) {
+                const size_t shapes[2][2] = {{layers[l]->get_out_dim(), layers[l]->get_inp_dim()}, {1, layers[l]->get_out_dim()}};
+                for (size_t k = 0; k < 2; k ++) {
+                    Tensor_Entry entry;
+                    std::memcpy(&entry, base + header.table_offset + (2 * l + k) * sizeof(Tensor_Entry), sizeof(Tensor_Entry));
+                    if (entry.rows != shapes[k][0] || entry.cols != shapes[k][1]) {
+                        throw std::runtime_error("Checkpoint parameters do not match its architecture: " + file_name);
+                    }
+                    if (entry.offset % tensor::ALIGNMENT != 0 || entry.offset + entry.rows * entry.cols * sizeof(T) > this->file.size()) {
+                        throw std::runtime_error("Truncated or corrupt checkpoint: " + file_name);
+                    }
+                    T* data = reinterpret_cast<T*>(this->file.mutable_data() + entry.offset);
+                    tensor::Tensor<T>& param = k == 0 ? layers[l]->get_W() : layers[l]->get_b();
+                    param = tensor::Tensor<T>::borrow(data, entry.rows, entry.cols);
+                    if (mode == Load_Mode::Copy) {
+                        param = tensor::Tensor<T>(param.view());
+                    }
+                }
+            }
+            if (mode == Load_Mode::Copy) {
+                this->file = io::Mapped_File();
+            }
+        }
+
+        // whether the parameters still live in the file mapping
+        bool mapped() const {
+            return !this->file.empty();
+        }
+
+        Neural_Network<T>& network() {
+            return *this->model;
+        }
+        const Neural_Network<T>& network() const {
+            return *this->model;
+        }
+        Neural_Network<T>* operator->() {
+            return this->model.get();
+        }
+    };
+
+    template <typename T>
+    Loaded_Model<T> load_checkpoint(const std::string& file_name, Load_Mode mode = Load_Mode::Map) {
+        return Loaded_Model<T>(file_name, mode);
+    }
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_FEATURES_X86 1
+#endif
+
+// Runtime detection of the instruction sets the SIMD kernels can use, so one binary built
+// without -march picks the widest kernels the machine (and the OS) supports.
+namespace cpu_features {
+
+    // ordered from narrowest to widest, so "isa >= Isa::AVX2" reads naturally
+    enum class Isa { Generic = 0, SSE2 = 1, AVX2 = 2, AVX512 = 3 };
+
+    struct Features {
+        bool sse2 = false;
+        bool avx = false;
+        bool avx2 = false;
+        bool fma = false;
+        bool f16c = false;
+        bool avx512f = false;
+        bool avx512bw = false;
+        bool avx512vl = false;
+        bool avx512_vnni = false;
+        bool avx512_bf16 = false;
+        bool avx_vnni = false;
+    };
+
+    namespace detail {
+
+#ifdef CPU_FEATURES_X86
+        inline uint64_t xgetbv0() {
+            uint32_t eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+        }
+#endif
+
+        inline Features detect() {
+            Features f;
+#ifdef CPU_FEATURES_X86
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+                return f;
+            }
+            f.sse2 = (edx >> 26) & 1;
+            const bool osxsave = (ecx >> 27) & 1;
+            const bool cpu_avx = (ecx >> 28) & 1;
+            const bool cpu_fma = (ecx >> 12) & 1;
+            const bool cpu_f16c = (ecx >> 29) & 1;
+
+            // the OS has to save the wider registers on context switch, otherwise the bits are useless
+            const uint64_t xcr0 = osxsave ? detail::xgetbv0() : 0;
+            const bool os_ymm = (xcr0 & 0x6) == 0x6;
+            const bool os_zmm = (xcr0 & 0xe6) == 0xe6;
+
+            f.avx = cpu_avx && os_ymm;
+            f.fma = cpu_fma && os_ymm;
+            f.f16c = cpu_f16c && os_ymm;
+
+            if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+                f.avx2 = ((ebx >> 5) & 1) && os_ymm;
+                f.avx512f = ((ebx >> 16) & 1) && os_zmm;
+                f.avx512bw = ((ebx >> 30) & 1) && os_zmm;
+                f.avx512vl = ((ebx >> 31) & 1) && os_zmm;
+                f.avx512_vnni = ((ecx >> 11) & 1) && os_zmm;
+            }
+            if (__get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx)) {
+                f.avx_vnni = ((eax >> 4) & 1) && os_ymm;
+                f.avx512_bf16 = ((eax >> 5) & 1) && os_zmm;
+            }
+#endif
+            return f;
+        }
+
+        inline Isa& isa_override() {
+            static Isa isa = Isa::AVX512;
+            return isa;
+        }
+    }
+
+    inline const Features& features() {
+        static const Features f = detail::detect();
+        return f;
+    }
+
+    // widest ISA the hardware supports, before any user cap is applied
+    inline Isa detected_isa() {
+        const Features& f = features();
+        if (f.avx512f && f.avx2 && f.fma) {
+            return Isa::AVX512;
+        }
+        if (f.avx2 && f.fma) {
+            return Isa::AVX2;
+        }
+        if (f.sse2) {
+            return Isa::SSE2;
+        }
+        return Isa::Generic;
+    }
+
+    // caps the ISA the kernels may use, e.g to compare kernels or to avoid AVX-512 frequency drops
+    inline void set_max_isa(Isa isa) {
+        detail::isa_override() = isa;
+    }
+
+    inline Isa active_isa() {
+        Isa detected = detected_isa();
+        Isa cap = detail::isa_override();
+        return static_cast<int>(cap) < static_cast<int>(detected) ? cap : detected;
+    }
+
+    inline std::string isa_name(Isa isa) {
+        switch (isa) {
+            case Isa::AVX512: return "avx512";
+            case Isa::AVX2: return "avx2";
+            case Isa::SSE2: return "sse2";
+            default: return "generic";
+        }
+    }
+}
+
+#endif
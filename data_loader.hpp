@@ -0,0 +1,397 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <memory>
+#include <condition_variable>
+
+#include "tensor.hpp"
+#include "scaler.hpp"
+#include "sparse.hpp"
+
+namespace data_utils {
+
+    struct Loader_Options {
+        size_t batch_size = 32;
+        bool shuffle = true;
+        // drop the last, smaller batch of an epoch
+        bool drop_last = false;
+        // background threads assembling batches
+        size_t num_workers = 1;
+        // batches buffered ahead of training: 2 is double buffering, 3 triple buffering
+        size_t prefetch = 3;
+        uint64_t seed = 0;
+        // > 0: also emit one-hot targets [batch, num_classes] built from the integer labels, which
+        // must then all lie in [0, num_classes)
+        size_t num_classes = 0;
+    };
+
+    // views into the loader's buffers, valid until the next call to Data_Loader::next
+    template <typename T>
+    struct Batch {
+        tensor::Tensor_View<const T> features;
+        tensor::Tensor_View<const T> labels;
+        tensor::Tensor_View<const T> targets;
+        size_t epoch = 0;
+        size_t index = 0;
+    };
+
+    namespace detail {
+
+        // The prefetching shared by the loaders. Background workers gather batches into a fixed ring
+        // of `prefetch` preallocated slots while the caller trains on the current one. Batches are
+        // numbered in one stream across epochs and batch g always goes to slot g % prefetch, which a
+        // worker may only refill once the caller has moved past batch g - prefetch. Workers therefore
+        // run ahead into the next epoch as well, and the indices are reshuffled (from seed and epoch,
+        // so runs are reproducible) as each epoch begins.
+        template <typename Slot>
+        class Prefetch_Ring {
+        public:
+            // fills a slot with rows idx[0], ..., idx[rows - 1] of the source
+            using Gather = std::function<void(Slot&, const size_t*, size_t)>;
+
+        private:
+            struct Entry {
+                Slot slot;
+                // the batch this slot may hold next, and whether it is filled
+                uint64_t allowed = 0;
+                bool ready = false;
+            };
+
+            Loader_Options options;
+            Gather gather;
+            size_t n_batches = 0;
+
+            std::vector<size_t> order;
+            uint64_t order_epoch = 0;
+            std::vector<Entry> entries;
+            std::vector<std::thread> workers;
+
+            std::mutex mutex;
+            std::condition_variable slot_free;
+            std::condition_variable slot_ready;
+            bool stop = false;
+            uint64_t next_ticket = 0;
+
+            // consumer side
+            uint64_t consume_ticket = 0;
+            bool holding = false;
+            bool boundary_reported = false;
+
+            void _shuffle(uint64_t epoch) {
+                std::iota(this->order.begin(), this->order.end(), size_t(0));
+                if (this->options.shuffle) {
+                    std::mt19937_64 rng(this->options.seed * 0x9E3779B97F4A7C15ull + epoch);
+                    std::shuffle(this->order.begin(), this->order.end(), rng);
+                }
+                this->order_epoch = epoch;
+            }
+
+            void _worker_loop() {
+                std::vector<size_t> idx(this->options.batch_size);
+                while (true) {
+                    uint64_t ticket;
+                    size_t rows;
+                    {
+                        std::unique_lock<std::mutex> lock(this->mutex);
+                        if (this->stop) {
+                            return;
+                        }
+                        ticket = this->next_ticket ++;
+                        // tickets are handed out in order, so every batch of the previous epoch has
+                        // already copied its indices when the first batch of a new one reshuffles
+                        const uint64_t epoch = ticket / this->n_batches;
+                        if (epoch != this->order_epoch) {
+                            this->_shuffle(epoch);
+                        }
+                        const size_t begin = (ticket % this->n_batches) * this->options.batch_size;
+                        rows = std::min(this->options.batch_size, this->order.size() - begin);
+                        std::copy(this->order.begin() + begin, this->order.begin() + begin + rows, idx.begin());
+
+                        Entry& entry = this->entries[ticket % this->entries.size()];
+                        this->slot_free.wait(lock, [&] { return this->stop || entry.allowed == ticket; });
+                        if (this->stop) {
+                            return;
+                        }
+                    }
+                    Entry& entry = this->entries[ticket % this->entries.size()];
+                    this->gather(entry.slot, idx.data(), rows);
+                    {
+                        std::lock_guard<std::mutex> lock(this->mutex);
+                        entry.ready = true;
+                    }
+                    this->slot_ready.notify_all();
+                }
+            }
+
+            void _release() {
+                if (!this->holding) {
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    Entry& entry = this->entries[(this->consume_ticket - 1) % this->entries.size()];
+                    entry.ready = false;
+                    entry.allowed = this->consume_ticket - 1 + this->entries.size();
+                }
+                this->holding = false;
+                this->slot_free.notify_all();
+            }
+
+        public:
+            Prefetch_Ring(size_t rows, const Loader_Options& options, Gather gather) : options(options), gather(std::move(gather)) {
+                if (options.batch_size == 0 || options.num_workers == 0 || options.prefetch == 0) {
+                    throw std::invalid_argument("batch_size, num_workers and prefetch must be positive.");
+                }
+                const size_t used = options.drop_last ? rows / options.batch_size * options.batch_size : rows;
+                this->n_batches = (used + options.batch_size - 1) / options.batch_size;
+                if (this->n_batches == 0) {
+                    throw std::invalid_argument("Dataset holds fewer samples than one batch.");
+                }
+                this->order.resize(rows);
+                this->_shuffle(0);
+                this->entries.resize(options.prefetch);
+                for (size_t s = 0; s < this->entries.size(); s ++) {
+                    this->entries[s].allowed = s;
+                }
+            }
+
+            Prefetch_Ring(const Prefetch_Ring&) = delete;
+            Prefetch_Ring& operator=(const Prefetch_Ring&) = delete;
+
+            ~Prefetch_Ring() {
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    this->stop = true;
+                }
+                this->slot_free.notify_all();
+                this->slot_ready.notify_all();
+                for (std::thread& t : this->workers) {
+                    t.join();
+                }
+            }
+
+            // for preallocating the slots, before start()
+            Slot& slot(size_t s) {
+                return this->entries[s].slot;
+            }
+            size_t num_slots() const {
+                return this->entries.size();
+            }
+
+            void start() {
+                for (size_t w = 0; w < this->options.num_workers; w ++) {
+                    this->workers.emplace_back(&Prefetch_Ring::_worker_loop, this);
+                }
+            }
+
+            size_t batches_per_epoch() const {
+                return this->n_batches;
+            }
+
+            // the slot holding the next batch of the current epoch, valid until the following call;
+            // nullptr once the epoch is exhausted, after which the following call starts the next one
+            const Slot* next(size_t& epoch, size_t& index) {
+                this->_release();
+                if (this->consume_ticket > 0 && this->consume_ticket % this->n_batches == 0 && !this->boundary_reported) {
+                    this->boundary_reported = true;
+                    return nullptr;
+                }
+                this->boundary_reported = false;
+
+                const uint64_t ticket = this->consume_ticket;
+                Entry& entry = this->entries[ticket % this->entries.size()];
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->slot_ready.wait(lock, [&] { return entry.ready && entry.allowed == ticket; });
+                }
+                this->consume_ticket += 1;
+                this->holding = true;
+                epoch = ticket / this->n_batches;
+                index = ticket % this->n_batches;
+                return &entry.slot;
+            }
+        };
+    }
+
+    // Minibatches over a dataset held as features [rows, num_features] and labels [rows, 1], e.g a
+    // Dataset or a Binary_Dataset, which must outlive the loader. Batches are prefetched by
+    // background workers, see detail::Prefetch_Ring. An optional fitted Scaler is applied to each
+    // row as it is copied into the batch, so the source data is never rewritten or duplicated.
+    template <typename T>
+    class Data_Loader {
+    private:
+        struct Slot {
+            tensor::Tensor<T> features;
+            tensor::Tensor<T> labels;
+            tensor::Tensor<T> targets;
+        };
+
+        tensor::Tensor_View<const T> src_features;
+        tensor::Tensor_View<const T> src_labels;
+        Loader_Options options;
+        const Scaler<T>* scaler = nullptr;
+        // last, so its workers stop before the members they read go away
+        std::unique_ptr<detail::Prefetch_Ring<Slot>> ring;
+
+        void _gather(Slot& slot, const size_t* idx, size_t rows) const {
+            const size_t cols = this->src_features.cols;
+            slot.features.resize(rows, cols);
+            slot.labels.resize(rows, 1);
+            for (size_t i = 0; i < rows; i ++) {
+                const T* src = this->src_features.row(idx[i]);
+                if (this->scaler != nullptr) {
+                    this->scaler->transform_row(src, slot.features.row(i));
+                }
+                else {
+                    std::copy(src, src + cols, slot.features.row(i));
+                }
+                slot.labels[i] = this->src_labels(idx[i], 0);
+            }
+            if (this->options.num_classes > 0) {
+                slot.targets.resize(rows, this->options.num_classes);
+                slot.targets.fill(static_cast<T>(0));
+                // the constructor has checked every label
+                for (size_t i = 0; i < rows; i ++) {
+                    slot.targets(i, static_cast<size_t>(slot.labels[i])) = static_cast<T>(1);
+                }
+            }
+        }
+
+    public:
+        // the scaler, when given, must outlive the loader
+        Data_Loader(tensor::Tensor_View<const T> features, tensor::Tensor_View<const T> labels, const Loader_Options& options = Loader_Options(), const Scaler<T>* scaler = nullptr)
+            : src_features(features), src_labels(labels), options(options), scaler(scaler) {
+            if (features.rows != labels.rows || labels.cols != 1) {
+                throw std::invalid_argument("Labels must be a [rows, 1] column matching the features.");
+            }
+            if (scaler != nullptr && scaler->num_features() != features.cols) {
+                throw std::invalid_argument("Scaler is not fitted to the dataset's features.");
+            }
+            // checked here rather than in the workers, as Cross_Entropy_Loss checks a label target
+            if (options.num_classes > 0) {
+                for (size_t i = 0; i < labels.rows; i ++) {
+                    if (!(labels(i, 0) >= 0 && labels(i, 0) < static_cast<T>(options.num_classes))) {
+                        throw std::invalid_argument("Class label out of range.");
+                    }
+                }
+            }
+            this->ring = std::make_unique<detail::Prefetch_Ring<Slot>>(features.rows, options, [this](Slot& slot, const size_t* idx, size_t rows) {
+                this->_gather(slot, idx, rows);
+            });
+            for (size_t s = 0; s < this->ring->num_slots(); s ++) {
+                Slot& slot = this->ring->slot(s);
+                slot.features = tensor::Tensor<T>(options.batch_size, features.cols);
+                slot.labels = tensor::Tensor<T>(options.batch_size, 1);
+                if (options.num_classes > 0) {
+                    slot.targets = tensor::Tensor<T>(options.batch_size, options.num_classes);
+                }
+            }
+            this->ring->start();
+        }
+
+        Data_Loader(const Data_Loader&) = delete;
+        Data_Loader& operator=(const Data_Loader&) = delete;
+
+        size_t batches_per_epoch() const {
+            return this->ring->batches_per_epoch();
+        }
+
+        // the next batch of the current epoch; false once the epoch is exhausted, after which the
+        // following call starts the next epoch
+        bool next(Batch<T>& batch) {
+            const Slot* slot = this->ring->next(batch.epoch, batch.index);
+            if (slot == nullptr) {
+                return false;
+            }
+            batch.features = slot->features.view();
+            batch.labels = slot->labels.view();
+            batch.targets = this->options.num_classes > 0 ? slot->targets.view() : tensor::Tensor_View<const T>();
+            return true;
+        }
+    };
+
+    // views into the loader's buffers, valid until the next call to Sparse_Data_Loader::next
+    template <typename T>
+    struct Sparse_Batch {
+        sparse::CSR_View<T> features;
+        tensor::Tensor_View<const T> labels;
+        size_t epoch = 0;
+        size_t index = 0;
+    };
+
+    // Data_Loader for CSR features, e.g a Sparse_Dataset from load_libsvm, which must outlive the
+    // loader: the same shuffling and prefetching, with every batch gathered into a CSR matrix of its
+    // own. There are no one-hot targets; Cross_Entropy_Loss takes the labels directly.
+    template <typename T>
+    class Sparse_Data_Loader {
+    private:
+        struct Slot {
+            sparse::CSR_Matrix<T> features;
+            tensor::Tensor<T> labels;
+        };
+
+        sparse::CSR_View<T> src_features;
+        tensor::Tensor_View<const T> src_labels;
+        std::unique_ptr<detail::Prefetch_Ring<Slot>> ring;
+
+        void _gather(Slot& slot, const size_t* idx, size_t rows) const {
+            slot.features.clear(this->src_features.cols);
+            slot.features.append_rows(this->src_features, idx, rows);
+            slot.labels.resize(rows, 1);
+            for (size_t i = 0; i < rows; i ++) {
+                slot.labels[i] = this->src_labels(idx[i], 0);
+            }
+        }
+
+    public:
+        Sparse_Data_Loader(sparse::CSR_View<T> features, tensor::Tensor_View<const T> labels, const Loader_Options& options = Loader_Options())
+            : src_features(features), src_labels(labels) {
+            if (features.rows != labels.rows || labels.cols != 1) {
+                throw std::invalid_argument("Labels must be a [rows, 1] column matching the features.");
+            }
+            if (options.num_classes > 0) {
+                throw std::invalid_argument("Sparse batches come with labels only, not one-hot targets.");
+            }
+            this->ring = std::make_unique<detail::Prefetch_Ring<Slot>>(features.rows, options, [this](Slot& slot, const size_t* idx, size_t rows) {
+                this->_gather(slot, idx, rows);
+            });
+            // room for a batch of rows of average density
+            const size_t nnz = features.rows > 0 ? features.nnz() / features.rows * options.batch_size : 0;
+            for (size_t s = 0; s < this->ring->num_slots(); s ++) {
+                Slot& slot = this->ring->slot(s);
+                slot.features.reserve(options.batch_size, nnz);
+                slot.labels = tensor::Tensor<T>(options.batch_size, 1);
+            }
+            this->ring->start();
+        }
+
+        Sparse_Data_Loader(const Sparse_Data_Loader&) = delete;
+        Sparse_Data_Loader& operator=(const Sparse_Data_Loader&) = delete;
+
+        size_t batches_per_epoch() const {
+            return this->ring->batches_per_epoch();
+        }
+
+        // as Data_Loader::next
+        bool next(Sparse_Batch<T>& batch) {
+            const Slot* slot = this->ring->next(batch.epoch, batch.index);
+            if (slot == nullptr) {
+                return false;
+            }
+            batch.features = slot->features.view();
+            batch.labels = slot->labels.view();
+            return true;
+        }
+    };
+}
+
+#endif
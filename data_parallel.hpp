@@ -0,0 +1,130 @@
+#ifndef DATA_PARALLEL_H
+#define DATA_PARALLEL_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cassert>
+
+#include "nn.hpp"
+#include "optimizer.hpp"
+#include "thread_pool.hpp"
+
+namespace neural_network {
+
+    namespace collective {
+
+        // out[i] = sum_w buffers[w][i]. The range is cut into cache-sized segments and the pool
+        // reduces different segments at the same time (a reduce-scatter), each summing the workers in
+        // index order, so the result does not depend on the thread count. out may alias buffers[0].
+        template <typename T>
+        void all_reduce_sum(const T* const* buffers, size_t num_buffers, T* out, size_t n) {
+            constexpr size_t SEGMENT = 4096;
+            const size_t n_segments = (n + SEGMENT - 1) / SEGMENT;
+            parallel::parallel_for(0, n_segments, 1, [&](size_t s0, size_t s1) {
+                const size_t begin = s0 * SEGMENT;
+                const size_t end = std::min(n, s1 * SEGMENT);
+                for (size_t i = begin; i < end; i ++) {
+                    out[i] = buffers[0][i];
+                }
+                for (size_t w = 1; w < num_buffers; w ++) {
+                    const T* src = buffers[w];
+                    for (size_t i = begin; i < end; i ++) {
+                        out[i] += src[i];
+                    }
+                }
+            });
+        }
+    }
+
+    // Splits every minibatch by rows across replicas of one model and runs them as pool tasks, each
+    // replica doing its own forward / backward on its shard (kernels inside a replica stay on that
+    // thread). Every replica keeps its parameters in a Parameter_Arena with the same layout, so the
+    // gradients are all-reduced straight from the replicas' gradient buffers into the model's, the
+    // optimizer (bound to the model's parameters, e.g. through model.parameter_arena()) steps them,
+    // and one flat copy broadcasts the new weights to each replica. Replica 0 is the model itself.
+    //
+    // Each shard normalizes its loss and gradient by the rows of the whole batch, so the gradients
+    // of the shards add up to the mean gradient of the batch and their losses to its mean loss.
+    template <typename T>
+    class Data_Parallel_Trainer {
+    private:
+        Neural_Network<T>& model;
+        std::vector<std::unique_ptr<Neural_Network<T>>> replicas;
+        // parameter arena of each replica (index 0: the model)
+        std::vector<Optimizer::Parameter_Arena<T>*> arenas;
+        std::vector<const T*> grad_ptrs;
+        std::vector<T> shard_loss;
+        // not owned; steps the model's parameters
+        Optimizer::Basic_Optimizer<T>& optimizer;
+
+        void _broadcast(size_t w) {
+            const T* src = this->arenas[0]->parameters();
+            std::copy(src, src + this->arenas[0]->size(), this->arenas[w]->parameters());
+        }
+
+    public:
+        // num_workers == 0: one replica per pool thread
+        Data_Parallel_Trainer(Neural_Network<T>& model, Optimizer::Basic_Optimizer<T>& optimizer, size_t num_workers = 0) : model(model), optimizer(optimizer) {
+            if (num_workers == 0) {
+                num_workers = parallel::num_threads();
+            }
+            this->arenas.push_back(&model.parameter_arena());
+            for (size_t w = 1; w < num_workers; w ++) {
+                this->replicas.push_back(std::make_unique<Neural_Network<T>>(model));
+                this->arenas.push_back(&this->replicas.back()->parameter_arena());
+            }
+            for (Optimizer::Parameter_Arena<T>* arena : this->arenas) {
+                this->grad_ptrs.push_back(arena->gradients());
+            }
+            this->shard_loss.resize(num_workers);
+        }
+
+        // copies the model's weights to every replica; needed after the model was changed outside train_step
+        void sync_replicas() {
+            parallel::parallel_for(1, this->num_workers(), 1, [&](size_t w0, size_t w1) {
+                for (size_t w = w0; w < w1; w ++) {
+                    this->_broadcast(w);
+                }
+            });
+        }
+
+        size_t num_workers() const {
+            return this->arenas.size();
+        }
+
+        // one optimizer step on the batch; returns its loss
+        T train_step(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<const T> target) {
+            assert(x_batch.rows == target.rows && "Batch and target must have the same number of rows.");
+            const size_t W = std::min(this->num_workers(), std::max<size_t>(1, x_batch.rows));
+
+            parallel::parallel_for(0, W, 1, [&](size_t w0, size_t w1) {
+                for (size_t w = w0; w < w1; w ++) {
+                    const size_t r0 = x_batch.rows * w / W;
+                    const size_t r1 = x_batch.rows * (w + 1) / W;
+                    Neural_Network<T>& net = (w == 0) ? this->model : *this->replicas[w - 1];
+                    // backward accumulates
+                    this->arenas[w]->zero_grad();
+                    this->shard_loss[w] = net.forward(x_batch.slice_rows(r0, r1 - r0), target.slice_rows(r0, r1 - r0), x_batch.rows).second;
+                    net.backward();
+                }
+            });
+
+            if (W > 1) {
+                collective::all_reduce_sum<T>(this->grad_ptrs.data(), W, this->arenas[0]->gradients(), this->arenas[0]->size());
+            }
+
+            this->optimizer.step();
+
+            this->sync_replicas();
+
+            T loss = 0;
+            for (size_t w = 0; w < W; w ++) {
+                loss += this->shard_loss[w];
+            }
+            return loss;
+        }
+    };
+}
+
+#endif
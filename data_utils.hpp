@@ -2,71 +2,412 @@
 #define DATA_UTILS_H
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
-#include <valarray>
 #include <string>
 #include <utility>
-#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <algorithm>
 
 #include "ops_utils.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "scaler.hpp"
+#include "sparse.hpp"
 
-std::vector<std::vector<std::valarray<double>>> minmax_scaler(const std::vector<std::vector<std::valarray<double>>>& X, double min_value, double max_value) {
-    // Implement your min-max scaling logic here
-    // For simplicity, return X as is in this placeholder
-    return X;
-}
+namespace data_utils {
+
+    // one sample per row of features, its label in the same row of labels ([rows, 1])
+    template <typename T>
+    struct Dataset {
+        tensor::Tensor<T> features;
+        tensor::Tensor<T> labels;
+
+        size_t rows() const {
+            return this->features.rows();
+        }
+        size_t num_features() const {
+            return this->features.cols();
+        }
+    };
+
+    // the same for wide sparse features, held in CSR
+    template <typename T>
+    struct Sparse_Dataset {
+        sparse::CSR_Matrix<T> features;
+        tensor::Tensor<T> labels;
 
-std::pair<std::vector<std::vector<std::valarray<double>>>, std::vector<std::vector<std::valarray<double>>>> get_data(const std::string& file_name, const bool& last_label = true, const bool& normalize = true, const int& skip_lines = 1) {
-    std::ifstream in_file;
-    in_file.open(file_name.c_str(), std::ios::in);
-    // If there is any problem in opening file
-    if (!in_file.is_open()) {
-        std::cerr << "ERROR (" << __func__ << ") : ";
-        std::cerr << "Unable to open file: " << file_name << std::endl;
-        std::exit(EXIT_FAILURE);
+        size_t rows() const {
+            return this->features.rows();
+        }
+        size_t num_features() const {
+            return this->features.cols();
+        }
+    };
+
+    struct Csv_Options {
+        // label in the last column, otherwise in the first one
+        bool last_label = true;
+        // header lines to skip before the data
+        size_t skip_lines = 0;
+        char delimiter = ',';
+    };
+
+    struct Libsvm_Options {
+        // 0: one more than the largest index in the file
+        size_t num_features = 0;
+        // libsvm indices start at 1; true for files that start them at 0
+        bool zero_based = false;
+    };
+
+    // scales every column of X onto [min_value, max_value] in place and returns the fitted scaler,
+    // e.g to save it for inference or to apply it to a test set
+    template <typename T>
+    Scaler<T> minmax_scaler(tensor::Tensor<T>& X, T min_value, T max_value) {
+        Scaler<T> scaler(Scaling::Min_Max, min_value, max_value);
+        scaler.fit(X.view());
+        scaler.transform(X.view(), X.view());
+        return scaler;
     }
 
-    std::vector<std::vector<std::valarray<double>>> X, Y;  // To store X and Y
-    std::string line;  // To store each line
+    namespace detail {
+
+        inline const char* line_end(const char* p, const char* end) {
+            const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+            return nl != nullptr ? static_cast<const char*>(nl) : end;
+        }
+
+        // whitespace-only lines (and the '\r' of CRLF files) carry no sample
+        inline bool is_blank(const char* p, const char* end) {
+            for (; p < end; p ++) {
+                if (*p != ' ' && *p != '\t' && *p != '\r') {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline const char* skip_spaces(const char* p, const char* end) {
+            while (p < end && (*p == ' ' || *p == '\t')) {
+                p ++;
+            }
+            return p;
+        }
+
+        // parses the `cols` fields of one line into out, false on a malformed line
+        template <typename T>
+        bool parse_line(const char* p, const char* end, char delimiter, size_t cols, T* out) {
+            if (end > p && end[-1] == '\r') {
+                end --;
+            }
+            for (size_t c = 0; c < cols; c ++) {
+                p = detail::skip_spaces(p, end);
+                if (p < end && *p == '+') {
+                    p ++;
+                }
+                std::from_chars_result res = std::from_chars(p, end, out[c]);
+                if (res.ec != std::errc()) {
+                    return false;
+                }
+                p = detail::skip_spaces(res.ptr, end);
+                if (c + 1 < cols) {
+                    if (p >= end || *p != delimiter) {
+                        return false;
+                    }
+                    p ++;
+                }
+            }
+            return p == end;
+        }
+
+        inline const char* token_end(const char* p, const char* end) {
+            while (p < end && *p != ' ' && *p != '\t') {
+                p ++;
+            }
+            return p;
+        }
+
+        // a line of a libsvm file without its '#' comment and trailing whitespace
+        inline const char* libsvm_data_end(const char* p, const char* end) {
+            const void* hash = std::memchr(p, '#', static_cast<size_t>(end - p));
+            if (hash != nullptr) {
+                end = static_cast<const char*>(hash);
+            }
+            while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+                end --;
+            }
+            return end;
+        }
+
+        // "qid:<n>" ranking tokens carry no feature
+        inline bool is_qid(const char* p, const char* end) {
+            return end - p >= 4 && std::memcmp(p, "qid:", 4) == 0;
+        }
+
+        // samples and nonzeros of the libsvm lines in [p, end), without parsing any number
+        inline void count_libsvm(const char* p, const char* end, size_t& rows, size_t& nnz) {
+            rows = 0;
+            nnz = 0;
+            while (p < end) {
+                const char* e = detail::line_end(p, end);
+                const char* d = detail::libsvm_data_end(p, e);
+                if (!detail::is_blank(p, d)) {
+                    rows += 1;
+                    const char* q = detail::token_end(detail::skip_spaces(p, d), d);
+                    while ((q = detail::skip_spaces(q, d)) < d) {
+                        const char* t = detail::token_end(q, d);
+                        nnz += !detail::is_qid(q, t);
+                        q = t;
+                    }
+                }
+                p = e + 1;
+            }
+        }
+
+        // "<label> <index>:<value> ..." into label and the first n entries of col and values (as many
+        // as count_libsvm counts for the line), indices made zero-based; false on a malformed line or
+        // an index at or past max_cols
+        template <typename T>
+        bool parse_libsvm_line(const char* p, const char* end, bool zero_based, uint64_t max_cols, T& label, uint32_t* col, T* values, size_t& n, uint64_t& max_index) {
+            p = detail::skip_spaces(p, end);
+            if (p < end && *p == '+') {
+                p ++;
+            }
+            std::from_chars_result res = std::from_chars(p, end, label);
+            if (res.ec != std::errc() || (res.ptr < end && *res.ptr != ' ' && *res.ptr != '\t')) {
+                return false;
+            }
+            p = res.ptr;
+            n = 0;
+            while ((p = detail::skip_spaces(p, end)) < end) {
+                const char* t = detail::token_end(p, end);
+                if (detail::is_qid(p, t)) {
+                    p = t;
+                    continue;
+                }
+                uint64_t index = 0;
+                res = std::from_chars(p, t, index);
+                if (res.ec != std::errc() || res.ptr >= t || *res.ptr != ':') {
+                    return false;
+                }
+                const char* v = res.ptr + 1;
+                if (v < t && *v == '+') {
+                    v ++;
+                }
+                res = std::from_chars(v, t, values[n]);
+                if (res.ec != std::errc() || res.ptr != t) {
+                    return false;
+                }
+                if (!zero_based) {
+                    if (index == 0) {
+                        return false;
+                    }
+                    index -= 1;
+                }
+                if (index >= max_cols) {
+                    return false;
+                }
+                col[n] = static_cast<uint32_t>(index);
+                max_index = std::max(max_index, index);
+                n += 1;
+                p = t;
+            }
+            return true;
+        }
+
+        inline size_t count_rows(const char* p, const char* end) {
+            size_t n = 0;
+            while (p < end) {
+                const char* e = detail::line_end(p, end);
+                n += !detail::is_blank(p, e);
+                p = e + 1;
+            }
+            return n;
+        }
+
+        // cuts [p, end), past a UTF-8 byte order mark and the first skip_lines lines, into chunks
+        // [bounds[c], bounds[c + 1]): a few per thread, none smaller than 1 MB, each starting right
+        // after a newline
+        inline std::vector<const char*> split_lines(const char* p, const char* end, size_t skip_lines = 0) {
+            if (end - p >= 3 && std::memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+                p += 3;
+            }
+            for (size_t i = 0; i < skip_lines && p < end; i ++) {
+                p = line_end(p, end) + 1;
+            }
+            p = std::min(p, end);
 
-    // Skip lines
-    for (int i = 0; i < skip_lines; i++) {
-        std::getline(in_file, line, '\n');  // Ignore line
+            const size_t bytes = static_cast<size_t>(end - p);
+            const size_t target = std::max<size_t>(size_t(1) << 20, bytes / (8 * parallel::num_threads()) + 1);
+            std::vector<const char*> bounds;
+            bounds.push_back(p);
+            while (bounds.back() < end) {
+                const char* next = bounds.back() + std::min(target, static_cast<size_t>(end - bounds.back()));
+                if (next < end) {
+                    next = std::min(end, line_end(next, end) + 1);
+                }
+                bounds.push_back(next);
+            }
+            return bounds;
+        }
     }
 
-    // While file has information
-    while (!in_file.eof() && std::getline(in_file, line, '\n')) {
-        std::valarray<double> x_data, y_data;  // To store single sample and label
-        std::stringstream ss(line);  // Constructing stringstream from line
-        std::string token;  // To store each token in line (separated by ',')
+    // Memory-maps the file and parses it in parallel: the text is cut into newline-aligned chunks,
+    // a first pass counts the samples of every chunk, the matrices are allocated once, and a second
+    // pass parses each chunk with std::from_chars straight into its rows. Throws std::runtime_error
+    // when the file cannot be read or a row is malformed.
+    template <typename T>
+    Dataset<T> load_csv(const std::string& file_name, const Csv_Options& options = Csv_Options()) {
+        io::Mapped_File file(file_name);
+        file.advise_sequential();
+        const char* p = file.data();
+        const char* end = p + file.size();
+        const std::vector<const char*> bounds = detail::split_lines(p, end, options.skip_lines);
+        const size_t n_chunks = bounds.size() - 1;
 
-        while (std::getline(ss, token, ',')) {  // For each token
-            // Insert numerical value of token in x_data
-            x_data = ops_utils::insert_element(x_data, std::stod(token));
+        // the first sample fixes the number of columns
+        const char* first = bounds.front();
+        while (first < end && detail::is_blank(first, detail::line_end(first, end))) {
+            first = detail::line_end(first, end) + 1;
+        }
+        if (first >= end) {
+            return Dataset<T>();
+        }
+        const char* first_end = detail::line_end(first, end);
+        const size_t cols = static_cast<size_t>(std::count(first, first_end, options.delimiter)) + 1;
+        if (cols < 2) {
+            throw std::runtime_error("CSV needs at least one feature column and one label column: " + file_name);
         }
 
-        // If label is in last column
-        if (last_label) {
-            y_data.resize(1);  // Assuming 1 neuron for simplicity
-            y_data[0] = x_data[x_data.size() - 1];
-            x_data = ops_utils::pop_back(x_data);  // Remove label from x_data
-        } else {
-            y_data.resize(1);  // Assuming 1 neuron for simplicity
-            y_data[0] = x_data[0];
-            x_data = ops_utils::pop_front(x_data);  // Remove label from x_data
+        std::vector<size_t> first_row(n_chunks + 1, 0);
+        parallel::parallel_for(0, n_chunks, 1, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; c ++) {
+                first_row[c + 1] = detail::count_rows(bounds[c], bounds[c + 1]);
+            }
+        });
+        for (size_t c = 0; c < n_chunks; c ++) {
+            first_row[c + 1] += first_row[c];
         }
+        const size_t rows = first_row[n_chunks];
 
-        // Push collected X_data and y_data in X and Y
-        X.push_back({x_data});
-        Y.push_back({y_data});
+        Dataset<T> data;
+        data.features = tensor::Tensor<T>(rows, cols - 1);
+        data.labels = tensor::Tensor<T>(rows, 1);
+        const size_t label_col = options.last_label ? cols - 1 : 0;
+        const size_t feature_col = options.last_label ? 0 : 1;
+
+        // first malformed row of every chunk, rows when there is none
+        std::vector<size_t> bad_row(n_chunks, rows);
+        parallel::parallel_for(0, n_chunks, 1, [&](size_t c0, size_t c1) {
+            std::vector<T> fields(cols);
+            for (size_t c = c0; c < c1; c ++) {
+                size_t row = first_row[c];
+                const char* q = bounds[c];
+                while (q < bounds[c + 1]) {
+                    const char* e = detail::line_end(q, bounds[c + 1]);
+                    if (!detail::is_blank(q, e)) {
+                        if (!detail::parse_line<T>(q, e, options.delimiter, cols, fields.data())) {
+                            bad_row[c] = row;
+                            break;
+                        }
+                        std::copy(fields.begin() + feature_col, fields.begin() + feature_col + cols - 1, data.features.row(row));
+                        data.labels[row] = fields[label_col];
+                        row ++;
+                    }
+                    q = e + 1;
+                }
+            }
+        });
+        for (size_t c = 0; c < n_chunks; c ++) {
+            if (bad_row[c] != rows) {
+                throw std::runtime_error("Malformed CSV row " + std::to_string(bad_row[c]) + " (expected " + std::to_string(cols) + " numeric fields) in " + file_name);
+            }
+        }
+        return data;
     }
-    if (normalize) {
-        X = minmax_scaler(X, 0.01, 1.0);
+
+    // Sparse features in the libsvm / svmlight text format, "<label> <index>:<value> ..." per line
+    // ('#' starts a comment, "qid:" tokens are skipped), straight into CSR. Parsed in parallel like
+    // load_csv: the first pass counts the samples and nonzeros of every chunk, so the arrays are
+    // allocated once and the second pass writes each chunk's rows in place. Throws
+    // std::runtime_error when the file cannot be read or a row is malformed.
+    template <typename T>
+    Sparse_Dataset<T> load_libsvm(const std::string& file_name, const Libsvm_Options& options = Libsvm_Options()) {
+        io::Mapped_File file(file_name);
+        file.advise_sequential();
+        const char* p = file.data();
+        const char* end = p + file.size();
+        const std::vector<const char*> bounds = detail::split_lines(p, end);
+        const size_t n_chunks = bounds.size() - 1;
+
+        std::vector<size_t> first_row(n_chunks + 1, 0), first_nnz(n_chunks + 1, 0);
+        parallel::parallel_for(0, n_chunks, 1, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; c ++) {
+                detail::count_libsvm(bounds[c], bounds[c + 1], first_row[c + 1], first_nnz[c + 1]);
+            }
+        });
+        for (size_t c = 0; c < n_chunks; c ++) {
+            first_row[c + 1] += first_row[c];
+            first_nnz[c + 1] += first_nnz[c];
+        }
+        const size_t rows = first_row[n_chunks];
+
+        Sparse_Dataset<T> data;
+        data.features.resize(rows, first_nnz[n_chunks]);
+        data.labels = tensor::Tensor<T>(rows, 1);
+        uint64_t* row_ptr = data.features.row_ptr_data();
+        row_ptr[0] = 0;
+        // indices must fit the 32-bit columns and leave Sparse_Linear_Layer its NO_ROW marker
+        const uint64_t max_cols = options.num_features > 0 ? options.num_features : uint64_t(UINT32_MAX);
+
+        // first malformed row of every chunk (rows when there is none), and the largest index
+        std::vector<size_t> bad_row(n_chunks, rows);
+        std::vector<uint64_t> max_index(n_chunks, 0);
+        parallel::parallel_for(0, n_chunks, 1, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; c ++) {
+                size_t row = first_row[c];
+                uint64_t offset = first_nnz[c];
+                const char* q = bounds[c];
+                while (q < bounds[c + 1]) {
+                    const char* e = detail::line_end(q, bounds[c + 1]);
+                    const char* d = detail::libsvm_data_end(q, e);
+                    if (!detail::is_blank(q, d)) {
+                        size_t row_nnz = 0;
+                        if (!detail::parse_libsvm_line<T>(q, d, options.zero_based, max_cols, data.labels[row], data.features.col_data() + offset, data.features.values_data() + offset, row_nnz, max_index[c])) {
+                            bad_row[c] = row;
+                            break;
+                        }
+                        offset += row_nnz;
+                        row_ptr[row + 1] = offset;
+                        row ++;
+                    }
+                    q = e + 1;
+                }
+            }
+        });
+        uint64_t largest = 0;
+        for (size_t c = 0; c < n_chunks; c ++) {
+            if (bad_row[c] != rows) {
+                throw std::runtime_error("Malformed libsvm row " + std::to_string(bad_row[c]) + " in " + file_name);
+            }
+            largest = std::max(largest, max_index[c]);
+        }
+        data.features.set_cols(options.num_features > 0 ? options.num_features : (first_nnz[n_chunks] > 0 ? largest + 1 : 0));
+        return data;
+    }
+
+    template <typename T = double>
+    Dataset<T> get_data(const std::string& file_name, const bool& last_label = true, const bool& normalize = true, const int& skip_lines = 1) {
+        Csv_Options options;
+        options.last_label = last_label;
+        options.skip_lines = static_cast<size_t>(std::max(skip_lines, 0));
+        Dataset<T> data = data_utils::load_csv<T>(file_name, options);
+        if (normalize) {
+            data_utils::minmax_scaler<T>(data.features, static_cast<T>(0.01), static_cast<T>(1.0));
+        }
+        return data;
     }
-    in_file.close();  // Closing file
-    return std::make_pair(X, Y);  // Return pair of X and Y
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,534 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#endif
+
+#include "tensor.hpp"
+#include "bfloat16.hpp"
+#include "cpu_features.hpp"
+#include "activation_kernels.hpp"
+#include "thread_pool.hpp"
+
+// C = alpha * A * B + beta * C on row-major views.
+//
+// The loops follow the usual Goto/BLIS structure:
+//   jc (NC columns of B, sized for L3) -> pc (KC depth, sized so an A and a B micro-panel fit in L1)
+//   -> ic (MC rows of A, sized for L2) -> jr / ir over MR x NR register tiles.
+// A and B blocks are packed into contiguous, zero-padded micro-panels so the microkernel
+// only ever streams unit-stride memory.
+//
+// B may also be stored in bfloat16 (weights, typically): it is widened to T while it is packed,
+// so only the bytes read from memory shrink and the microkernels accumulate in T as usual.
+namespace gemm {
+
+    template <typename T>
+    struct Blocking;
+
+    template <>
+    struct Blocking<double> {
+        static constexpr size_t MR = 6;
+        static constexpr size_t NR = 8;
+        static constexpr size_t KC = 256;
+        static constexpr size_t MC = 96;
+        static constexpr size_t NC = 4096;
+    };
+
+    template <>
+    struct Blocking<float> {
+        static constexpr size_t MR = 6;
+        static constexpr size_t NR = 16;
+        static constexpr size_t KC = 256;
+        static constexpr size_t MC = 96;
+        static constexpr size_t NC = 4096;
+    };
+
+    // below this many multiply-adds a GEMM stays on the calling thread
+    constexpr size_t GEMM_PARALLEL_MIN_WORK = size_t(1) << 18;
+    // column block when all of A fits in one row block
+    constexpr size_t NC_SMALL_M = 512;
+
+    namespace detail {
+
+        // packing buffers live for the whole thread so steady-state calls never allocate
+        template <typename T>
+        tensor::Tensor<T>& a_pack_buffer() {
+            static thread_local tensor::Tensor<T> buffer;
+            return buffer;
+        }
+
+        template <typename T>
+        tensor::Tensor<T>& b_pack_buffer() {
+            static thread_local tensor::Tensor<T> buffer;
+            return buffer;
+        }
+
+        // A[mc, kc] -> ceil(mc / MR) panels, each stored k-major as kc x MR
+        template <typename T>
+        void pack_A(size_t mc, size_t kc, const T* A, size_t lda, T* packed) {
+            constexpr size_t MR = Blocking<T>::MR;
+            for (size_t ir = 0; ir < mc; ir += MR) {
+                size_t mr = std::min(MR, mc - ir);
+                for (size_t k = 0; k < kc; k ++) {
+                    for (size_t i = 0; i < mr; i ++) {
+                        packed[i] = A[(ir + i) * lda + k];
+                    }
+                    for (size_t i = mr; i < MR; i ++) {
+                        packed[i] = 0;
+                    }
+                    packed += MR;
+                }
+            }
+        }
+
+        // same panels as pack_A, but read from At[kc, mc] so that A = At^T is never materialized
+        template <typename T>
+        void pack_A_transposed(size_t mc, size_t kc, const T* At, size_t ldat, T* packed) {
+            constexpr size_t MR = Blocking<T>::MR;
+            for (size_t ir = 0; ir < mc; ir += MR) {
+                size_t mr = std::min(MR, mc - ir);
+                for (size_t k = 0; k < kc; k ++) {
+                    const T* a = At + k * ldat + ir;
+                    for (size_t i = 0; i < mr; i ++) {
+                        packed[i] = a[i];
+                    }
+                    for (size_t i = mr; i < MR; i ++) {
+                        packed[i] = 0;
+                    }
+                    packed += MR;
+                }
+            }
+        }
+
+        // B elements as the microkernel's type
+        template <typename T>
+        inline T widen(T value) {
+            return value;
+        }
+        template <typename T>
+        inline T widen(tensor::bfloat16 value) {
+            return static_cast<T>(static_cast<float>(value));
+        }
+
+        // B[kc, nc] -> ceil(nc / NR) panels, each stored k-major as kc x NR
+        template <typename T, typename TB>
+        void pack_B(size_t kc, size_t nc, const TB* B, size_t ldb, T* packed) {
+            constexpr size_t NR = Blocking<T>::NR;
+            for (size_t jr = 0; jr < nc; jr += NR) {
+                size_t nr = std::min(NR, nc - jr);
+                for (size_t k = 0; k < kc; k ++) {
+                    const TB* b = B + k * ldb + jr;
+                    for (size_t j = 0; j < nr; j ++) {
+                        packed[j] = detail::widen<T>(b[j]);
+                    }
+                    for (size_t j = nr; j < NR; j ++) {
+                        packed[j] = 0;
+                    }
+                    packed += NR;
+                }
+            }
+        }
+
+        // same panels as pack_B, but read from Bt[nc, kc] so that B = Bt^T is never materialized
+        // (k outer so the panel is written sequentially, reading NR rows of Bt side by side)
+        template <typename T, typename TB>
+        void pack_B_transposed(size_t kc, size_t nc, const TB* Bt, size_t ldbt, T* packed) {
+            constexpr size_t NR = Blocking<T>::NR;
+            for (size_t jr = 0; jr < nc; jr += NR) {
+                size_t nr = std::min(NR, nc - jr);
+                const TB* b = Bt + jr * ldbt;
+                if (nr == NR) {
+                    for (size_t k = 0; k < kc; k ++) {
+                        for (size_t j = 0; j < NR; j ++) {
+                            packed[j] = detail::widen<T>(b[j * ldbt + k]);
+                        }
+                        packed += NR;
+                    }
+                }
+                else {
+                    for (size_t k = 0; k < kc; k ++) {
+                        for (size_t j = 0; j < nr; j ++) {
+                            packed[j] = detail::widen<T>(b[j * ldbt + k]);
+                        }
+                        for (size_t j = nr; j < NR; j ++) {
+                            packed[j] = 0;
+                        }
+                        packed += NR;
+                    }
+                }
+            }
+        }
+
+        // portable microkernel: fixed trip counts let the compiler keep the tile in registers
+        template <typename T>
+        void kernel_generic(size_t kc, T alpha, const T* a, const T* b, T beta, T* c, size_t ldc) {
+            constexpr size_t MR = Blocking<T>::MR;
+            constexpr size_t NR = Blocking<T>::NR;
+            T acc[MR][NR] = {};
+            for (size_t k = 0; k < kc; k ++) {
+                for (size_t i = 0; i < MR; i ++) {
+                    const T a_ik = a[i];
+                    for (size_t j = 0; j < NR; j ++) {
+                        acc[i][j] += a_ik * b[j];
+                    }
+                }
+                a += MR;
+                b += NR;
+            }
+            for (size_t i = 0; i < MR; i ++) {
+                T* c_row = c + i * ldc;
+                if (beta == static_cast<T>(0)) {
+                    for (size_t j = 0; j < NR; j ++) {
+                        c_row[j] = alpha * acc[i][j];
+                    }
+                }
+                else {
+                    for (size_t j = 0; j < NR; j ++) {
+                        c_row[j] = alpha * acc[i][j] + beta * c_row[j];
+                    }
+                }
+            }
+        }
+
+#ifdef GEMM_X86
+        // 6x8 double tile: 12 ymm accumulators, 2 for the B row, 1 broadcast of A
+        __attribute__((target("avx2,fma")))
+        inline void kernel_avx2(size_t kc, double alpha, const double* a, const double* b, double beta, double* c, size_t ldc) {
+            __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+            __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+            __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+            __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+            __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+            __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+            for (size_t k = 0; k < kc; k ++) {
+                __m256d b0 = _mm256_load_pd(b);
+                __m256d b1 = _mm256_load_pd(b + 4);
+                __m256d a_i;
+                a_i = _mm256_broadcast_sd(a + 0); c00 = _mm256_fmadd_pd(a_i, b0, c00); c01 = _mm256_fmadd_pd(a_i, b1, c01);
+                a_i = _mm256_broadcast_sd(a + 1); c10 = _mm256_fmadd_pd(a_i, b0, c10); c11 = _mm256_fmadd_pd(a_i, b1, c11);
+                a_i = _mm256_broadcast_sd(a + 2); c20 = _mm256_fmadd_pd(a_i, b0, c20); c21 = _mm256_fmadd_pd(a_i, b1, c21);
+                a_i = _mm256_broadcast_sd(a + 3); c30 = _mm256_fmadd_pd(a_i, b0, c30); c31 = _mm256_fmadd_pd(a_i, b1, c31);
+                a_i = _mm256_broadcast_sd(a + 4); c40 = _mm256_fmadd_pd(a_i, b0, c40); c41 = _mm256_fmadd_pd(a_i, b1, c41);
+                a_i = _mm256_broadcast_sd(a + 5); c50 = _mm256_fmadd_pd(a_i, b0, c50); c51 = _mm256_fmadd_pd(a_i, b1, c51);
+                a += 6;
+                b += 8;
+            }
+            __m256d acc[6][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+            __m256d va = _mm256_set1_pd(alpha);
+            __m256d vb = _mm256_set1_pd(beta);
+            for (size_t i = 0; i < 6; i ++) {
+                double* c_row = c + i * ldc;
+                for (size_t h = 0; h < 2; h ++) {
+                    __m256d r = _mm256_mul_pd(va, acc[i][h]);
+                    if (beta != 0.0) {
+                        r = _mm256_fmadd_pd(vb, _mm256_loadu_pd(c_row + 4 * h), r);
+                    }
+                    _mm256_storeu_pd(c_row + 4 * h, r);
+                }
+            }
+        }
+
+        // 6x16 float tile, same register layout as the double kernel
+        __attribute__((target("avx2,fma")))
+        inline void kernel_avx2(size_t kc, float alpha, const float* a, const float* b, float beta, float* c, size_t ldc) {
+            __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+            __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+            __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+            __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+            __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+            __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+            for (size_t k = 0; k < kc; k ++) {
+                __m256 b0 = _mm256_load_ps(b);
+                __m256 b1 = _mm256_load_ps(b + 8);
+                __m256 a_i;
+                a_i = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(a_i, b0, c00); c01 = _mm256_fmadd_ps(a_i, b1, c01);
+                a_i = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(a_i, b0, c10); c11 = _mm256_fmadd_ps(a_i, b1, c11);
+                a_i = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(a_i, b0, c20); c21 = _mm256_fmadd_ps(a_i, b1, c21);
+                a_i = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(a_i, b0, c30); c31 = _mm256_fmadd_ps(a_i, b1, c31);
+                a_i = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(a_i, b0, c40); c41 = _mm256_fmadd_ps(a_i, b1, c41);
+                a_i = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(a_i, b0, c50); c51 = _mm256_fmadd_ps(a_i, b1, c51);
+                a += 6;
+                b += 16;
+            }
+            __m256 acc[6][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+            __m256 va = _mm256_set1_ps(alpha);
+            __m256 vb = _mm256_set1_ps(beta);
+            for (size_t i = 0; i < 6; i ++) {
+                float* c_row = c + i * ldc;
+                for (size_t h = 0; h < 2; h ++) {
+                    __m256 r = _mm256_mul_ps(va, acc[i][h]);
+                    if (beta != 0.0f) {
+                        r = _mm256_fmadd_ps(vb, _mm256_loadu_ps(c_row + 8 * h), r);
+                    }
+                    _mm256_storeu_ps(c_row + 8 * h, r);
+                }
+            }
+        }
+
+#endif
+
+        template <typename T>
+        void kernel(size_t kc, T alpha, const T* a, const T* b, T beta, T* c, size_t ldc) {
+#ifdef GEMM_X86
+            if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>) {
+                if (cpu_features::active_isa() >= cpu_features::Isa::AVX2) {
+                    kernel_avx2(kc, alpha, a, b, beta, c, ldc);
+                    return;
+                }
+            }
+#endif
+            kernel_generic<T>(kc, alpha, a, b, beta, c, ldc);
+        }
+
+        // partial tiles on the right / bottom edge go through a full-size scratch tile
+        template <typename T>
+        void kernel_edge(size_t mr, size_t nr, size_t kc, T alpha, const T* a, const T* b, T beta, T* c, size_t ldc) {
+            constexpr size_t MR = Blocking<T>::MR;
+            constexpr size_t NR = Blocking<T>::NR;
+            alignas(tensor::ALIGNMENT) T tile[MR * NR];
+            kernel<T>(kc, alpha, a, b, static_cast<T>(0), tile, NR);
+            for (size_t i = 0; i < mr; i ++) {
+                T* c_row = c + i * ldc;
+                const T* t_row = tile + i * NR;
+                if (beta == static_cast<T>(0)) {
+                    for (size_t j = 0; j < nr; j ++) {
+                        c_row[j] = t_row[j];
+                    }
+                }
+                else {
+                    for (size_t j = 0; j < nr; j ++) {
+                        c_row[j] = t_row[j] + beta * c_row[j];
+                    }
+                }
+            }
+        }
+
+        template <typename T>
+        void scale(tensor::Tensor_View<T> C, T beta) {
+            for (size_t i = 0; i < C.rows; i ++) {
+                T* c = C.row(i);
+                for (size_t j = 0; j < C.cols; j ++) {
+                    c[j] = (beta == static_cast<T>(0)) ? static_cast<T>(0) : beta * c[j];
+                }
+            }
+        }
+    }
+
+    // Epilogues run once per finished C tile, right after its last depth block is stored, while
+    // the tile is still in L1. They receive the tile pointer, its leading dimension, the tile's
+    // origin in C and its extent.
+    struct No_Epilogue {
+        template <typename T>
+        void operator()(T*, size_t, size_t, size_t, size_t, size_t) const {}
+    };
+
+    // adds bias[j] to every row of C, i.e the "+ b" of a linear layer
+    template <typename T>
+    struct Bias_Epilogue {
+        const T* bias;
+
+        void operator()(T* c, size_t ldc, size_t, size_t col0, size_t mr, size_t nr) const {
+            const T* b = this->bias + col0;
+            for (size_t i = 0; i < mr; i ++) {
+                T* c_row = c + i * ldc;
+                for (size_t j = 0; j < nr; j ++) {
+                    c_row[j] += b[j];
+                }
+            }
+        }
+    };
+
+    // op(X) is X itself or its transpose; a transposed operand is only ever read through its strides
+    enum class Transpose { No, Yes };
+
+    // bias add followed by an elementwise activation, applied to the tile in place
+    template <typename T>
+    struct Bias_Activation_Epilogue {
+        const T* bias;
+        act_kernels::Activation activation;
+
+        void operator()(T* c, size_t ldc, size_t row0, size_t col0, size_t mr, size_t nr) const {
+            Bias_Epilogue<T>{this->bias}(c, ldc, row0, col0, mr, nr);
+            for (size_t i = 0; i < mr; i ++) {
+                act_kernels::activation_forward<T>(this->activation, c + i * ldc, c + i * ldc, nr);
+            }
+        }
+    };
+
+    namespace detail {
+
+        template <typename T, typename TB, typename Epilogue>
+        void gemm_blocked(Transpose trans_a, Transpose trans_b, T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const TB> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue) {
+            constexpr size_t MR = Blocking<T>::MR;
+            constexpr size_t NR = Blocking<T>::NR;
+            constexpr size_t KC = Blocking<T>::KC;
+            constexpr size_t MC = Blocking<T>::MC;
+            constexpr size_t NC = Blocking<T>::NC;
+
+            const size_t M = C.rows;
+            const size_t N = C.cols;
+            const size_t K = (trans_a == Transpose::Yes) ? A.rows : A.cols;
+            if (M == 0 || N == 0) {
+                return;
+            }
+            if (K == 0 || alpha == static_cast<T>(0)) {
+                detail::scale<T>(C, beta);
+                epilogue(C.data, C.stride, 0, 0, M, N);
+                return;
+            }
+
+            // every pc block is packed once into the calling thread's B buffer (panels split across the
+            // pool), then the C block is cut into row-block x column-group tasks that each pack their own
+            // A block. K is never split, so every tile sums in the same order whatever the thread count.
+            parallel::Thread_Pool& pool = parallel::default_pool();
+            const size_t P = (M * N * K < GEMM_PARALLEL_MIN_WORK) ? 1 : pool.size();
+
+            size_t mc_block = MC;
+            if (P > 1 && (M + MC - 1) / MC < P) {
+                mc_block = std::max(MR, ((M + P - 1) / P + MR - 1) / MR * MR);
+            }
+            const size_t m_blocks = (M + mc_block - 1) / mc_block;
+            // with a single row block a packed B block is used only once, so keep it small enough to
+            // still be in L2 when the microkernels read it back (small batches, e.g at inference)
+            const size_t nc_block = (m_blocks == 1) ? std::min(NC, NC_SMALL_M) : NC;
+
+            tensor::Tensor<T>& b_pack = detail::b_pack_buffer<T>();
+            b_pack.resize(1, ((std::min(nc_block, N) + NR - 1) / NR) * NR * std::min(KC, K));
+
+            for (size_t jc = 0; jc < N; jc += nc_block) {
+                const size_t nc = std::min(nc_block, N - jc);
+                const size_t n_panels = (nc + NR - 1) / NR;
+                // a few tasks per thread so stealing can balance them; a group never gets narrower than 4 panels
+                size_t n_groups = 1;
+                if (P > 1) {
+                    n_groups = std::min((4 * P + m_blocks - 1) / m_blocks, std::max<size_t>(1, n_panels / 4));
+                }
+                const size_t group_panels = (n_panels + n_groups - 1) / n_groups;
+                n_groups = (n_panels + group_panels - 1) / group_panels;
+
+                for (size_t pc = 0; pc < K; pc += KC) {
+                    const size_t kc = std::min(KC, K - pc);
+                    const bool last_pc = (pc + kc == K);
+                    // later depth blocks accumulate on top of the first one
+                    const T beta_pc = (pc == 0) ? beta : static_cast<T>(1);
+                    T* b_packed = b_pack.data();
+
+                    // a grain covering the whole range keeps a small GEMM on the calling thread
+                    pool.parallel_for(0, n_panels, (P > 1) ? 4 : n_panels, [&](size_t p0, size_t p1) {
+                        const size_t j0 = p0 * NR;
+                        const size_t cols = std::min(nc, p1 * NR) - j0;
+                        if (trans_b == Transpose::Yes) {
+                            detail::pack_B_transposed<T, TB>(kc, cols, B.row(jc + j0) + pc, B.stride, b_packed + j0 * kc);
+                        }
+                        else {
+                            detail::pack_B<T, TB>(kc, cols, B.row(pc) + jc + j0, B.stride, b_packed + j0 * kc);
+                        }
+                    });
+
+                    pool.parallel_for(0, m_blocks * n_groups, (P > 1) ? 1 : m_blocks * n_groups, [&](size_t t0, size_t t1) {
+                        tensor::Tensor<T>& a_pack = detail::a_pack_buffer<T>();
+                        a_pack.resize(1, ((std::min(mc_block, M) + MR - 1) / MR) * MR * std::min(KC, K));
+                        size_t packed_block = m_blocks;
+                        for (size_t t = t0; t < t1; t ++) {
+                            const size_t ib = t / n_groups;
+                            const size_t ic = ib * mc_block;
+                            const size_t mc = std::min(mc_block, M - ic);
+                            const size_t j_begin = (t % n_groups) * group_panels * NR;
+                            const size_t j_end = std::min(nc, j_begin + group_panels * NR);
+                            if (ib != packed_block) {
+                                if (trans_a == Transpose::Yes) {
+                                    detail::pack_A_transposed<T>(mc, kc, A.row(pc) + ic, A.stride, a_pack.data());
+                                }
+                                else {
+                                    detail::pack_A<T>(mc, kc, A.row(ic) + pc, A.stride, a_pack.data());
+                                }
+                                packed_block = ib;
+                            }
+
+                            for (size_t jr = j_begin; jr < j_end; jr += NR) {
+                                const size_t nr = std::min(NR, nc - jr);
+                                const T* b_panel = b_packed + jr * kc;
+                                for (size_t ir = 0; ir < mc; ir += MR) {
+                                    const size_t mr = std::min(MR, mc - ir);
+                                    const T* a_panel = a_pack.data() + ir * kc;
+                                    T* c_tile = C.row(ic + ir) + jc + jr;
+                                    if (mr == MR && nr == NR) {
+                                        detail::kernel<T>(kc, alpha, a_panel, b_panel, beta_pc, c_tile, C.stride);
+                                    }
+                                    else {
+                                        detail::kernel_edge<T>(mr, nr, kc, alpha, a_panel, b_panel, beta_pc, c_tile, C.stride);
+                                    }
+                                    if (last_pc) {
+                                        epilogue(c_tile, C.stride, ic + ir, jc + jr, mr, nr);
+                                    }
+                                }
+                            }
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+    namespace detail {
+        template <typename T, typename TB, typename Epilogue>
+        void gemm_checked(Transpose trans_a, Transpose trans_b, T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const TB> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue) {
+            const size_t M = (trans_a == Transpose::Yes) ? A.cols : A.rows;
+            const size_t K_a = (trans_a == Transpose::Yes) ? A.rows : A.cols;
+            const size_t K_b = (trans_b == Transpose::Yes) ? B.cols : B.rows;
+            const size_t N = (trans_b == Transpose::Yes) ? B.rows : B.cols;
+            assert(K_a == K_b && "Inner dimensions of op(A) and op(B) must agree.");
+            assert(C.rows == M && C.cols == N && "C must have shape [rows of op(A), cols of op(B)].");
+            detail::gemm_blocked<T, TB>(trans_a, trans_b, alpha, A, B, beta, C, epilogue);
+        }
+    }
+
+    // C = alpha * op(A) * op(B) + beta * C; C is not read when beta == 0
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm(Transpose trans_a, Transpose trans_b, T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        detail::gemm_checked<T, T>(trans_a, trans_b, alpha, A, B, beta, C, epilogue);
+    }
+
+    // the same with B stored in bfloat16 and everything else, accumulation included, in T
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm(Transpose trans_a, Transpose trans_b, T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const tensor::bfloat16> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        detail::gemm_checked<T, tensor::bfloat16>(trans_a, trans_b, alpha, A, B, beta, C, epilogue);
+    }
+
+    // C[M, N] = alpha * A[M, K] * B[K, N] + beta * C
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm(T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        gemm::gemm<T>(Transpose::No, Transpose::No, alpha, A, B, beta, C, epilogue);
+    }
+
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm(T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const tensor::bfloat16> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        gemm::gemm<T>(Transpose::No, Transpose::No, alpha, A, B, beta, C, epilogue);
+    }
+
+    // C[M, N] = alpha * A[M, K] * Bt[N, K]^T + beta * C, e.g X * W^T for a weight matrix stored as [out, inp]
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm_nt(T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> Bt, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        gemm::gemm<T>(Transpose::No, Transpose::Yes, alpha, A, Bt, beta, C, epilogue);
+    }
+
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm_nt(T alpha, tensor::Tensor_View<const T> A, tensor::Tensor_View<const tensor::bfloat16> Bt, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        gemm::gemm<T>(Transpose::No, Transpose::Yes, alpha, A, Bt, beta, C, epilogue);
+    }
+
+    // C[M, N] = alpha * At[K, M]^T * B[K, N] + beta * C, e.g dY^T * X summed over the batch
+    template <typename T, typename Epilogue = No_Epilogue>
+    void gemm_tn(T alpha, tensor::Tensor_View<const T> At, tensor::Tensor_View<const T> B, T beta, tensor::Tensor_View<T> C, const Epilogue& epilogue = Epilogue()) {
+        gemm::gemm<T>(Transpose::Yes, Transpose::No, alpha, At, B, beta, C, epilogue);
+    }
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "gemm.hpp"
+#include "ops_utils.hpp"
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+
+// GFLOPS of gemm::gemm for square and skinny shapes, float and double, on the pool's threads.
+
+template <typename T>
+static void bench(const char* name, size_t M, size_t N, size_t K) {
+    tensor::Tensor<T> A = ops_utils::init_matrix::generate_uniform_matrix<T>(M, K);
+    tensor::Tensor<T> B = ops_utils::init_matrix::generate_uniform_matrix<T>(K, N);
+    tensor::Tensor<T> C(M, N, static_cast<T>(0));
+    const double flops = 2.0 * M * N * K;
+    // one warm-up call sizes the packing buffers, then about 2 GFLOP of timed calls
+    gemm::gemm<T>(1, A, B, 0, C);
+    const int reps = std::max(1, static_cast<int>(2e9 / flops));
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r ++) {
+        gemm::gemm<T>(1, A, B, 0, C);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-6s %5zu x %5zu x %5zu  %8.2f GFLOPS\n", name, M, N, K, flops * reps / seconds / 1e9);
+}
+
+int main() {
+    for (size_t n : {512, 1024, 2048}) {
+        bench<float>("float", n, n, n);
+        bench<double>("double", n, n, n);
+    }
+    // skinny: a small batch through a wide layer, and a tall batch through a narrow one
+    bench<float>("float", 16, 2048, 2048);
+    bench<double>("double", 16, 2048, 2048);
+    bench<float>("float", 4096, 512, 512);
+    bench<double>("double", 4096, 512, 512);
+    return 0;
+}
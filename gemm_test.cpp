@@ -0,0 +1,98 @@
+#include "gemm.hpp"
+#include "ops_utils.hpp"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Checks gemm::gemm / gemm_nt / gemm_tn against a long double triple loop: every transpose
+// combination, several alpha / beta, edge and degenerate shapes, strided views, float and double.
+// Prints the worst error per type and exits non-zero on failure.
+
+template <typename T>
+static T at(tensor::Tensor_View<const T> X, bool trans, size_t i, size_t j) {
+    return trans ? X(j, i) : X(i, j);
+}
+
+// max |C - C_ref| / (K + 1), in units of the type's epsilon
+template <typename T>
+static double check(bool yes_a, bool yes_b, size_t M, size_t N, size_t K, T alpha, T beta, bool strided, unsigned int seed) {
+    // strided operands are column slices of wider tensors
+    const size_t pad = strided ? 3 : 0;
+    tensor::Tensor<T> A_full = ops_utils::init_matrix::generate_uniform_matrix<T>(yes_a ? K : M, (yes_a ? M : K) + pad, -1, 1, seed);
+    tensor::Tensor<T> B_full = ops_utils::init_matrix::generate_uniform_matrix<T>(yes_b ? N : K, (yes_b ? K : N) + pad, -1, 1, seed + 1);
+    tensor::Tensor<T> C_full = ops_utils::init_matrix::generate_uniform_matrix<T>(M, N + pad, -1, 1, seed + 2);
+    tensor::Tensor_View<const T> A = A_full.view().slice_cols(0, yes_a ? M : K);
+    tensor::Tensor_View<const T> B = B_full.view().slice_cols(0, yes_b ? K : N);
+    tensor::Tensor<T> C_ref(M, N);
+    for (size_t i = 0; i < M; i ++) {
+        for (size_t j = 0; j < N; j ++) {
+            long double s = 0;
+            for (size_t k = 0; k < K; k ++) {
+                s += static_cast<long double>(at<T>(A, yes_a, i, k)) * at<T>(B, yes_b, k, j);
+            }
+            C_ref(i, j) = static_cast<T>(alpha * s + (beta == 0 ? 0 : static_cast<long double>(beta) * C_full(i, j)));
+        }
+    }
+    // beta == 0 must not read C: poison it
+    if (beta == 0) {
+        C_full.fill(std::numeric_limits<T>::quiet_NaN());
+    }
+    tensor::Tensor_View<T> C = C_full.view().slice_cols(0, N);
+    if (!yes_a && !yes_b) {
+        gemm::gemm<T>(alpha, A, B, beta, C);
+    } else if (!yes_a && yes_b) {
+        gemm::gemm_nt<T>(alpha, A, B, beta, C);
+    } else if (yes_a && !yes_b) {
+        gemm::gemm_tn<T>(alpha, A, B, beta, C);
+    } else {
+        gemm::gemm<T>(gemm::Transpose::Yes, gemm::Transpose::Yes, alpha, A, B, beta, C);
+    }
+    double err = 0;
+    for (size_t i = 0; i < M; i ++) {
+        for (size_t j = 0; j < N; j ++) {
+            const double e = std::abs(static_cast<double>(C(i, j)) - static_cast<double>(C_ref(i, j)));
+            err = std::isnan(e) ? std::numeric_limits<double>::infinity() : std::max(err, e);
+        }
+        // the padding columns of C are never written
+        for (size_t j = N; j < N + pad; j ++) {
+            if (beta == 0 && !std::isnan(C_full(i, j))) {
+                err = std::numeric_limits<double>::infinity();
+            }
+        }
+    }
+    return err / (static_cast<double>(K) + 1) / std::numeric_limits<T>::epsilon();
+}
+
+template <typename T>
+static bool run(const char* name) {
+    const size_t shapes[][3] = {
+        {1, 1, 1}, {7, 9, 5}, {6, 16, 256}, {13, 17, 300}, {100, 37, 513}, {97, 4100, 20},
+        {150, 70, 600}, {1, 1000, 700}, {1000, 1, 700}, {0, 3, 3}, {3, 0, 3}, {3, 3, 0},
+    };
+    double worst = 0;
+    unsigned int seed = 1;
+    for (const auto& s : shapes) {
+        for (bool yes_a : {false, true}) {
+            for (bool yes_b : {false, true}) {
+                for (T alpha : {T(1), T(-0.5)}) {
+                    for (T beta : {T(0), T(1), T(0.3)}) {
+                        for (bool strided : {false, true}) {
+                            worst = std::max(worst, check<T>(yes_a, yes_b, s[0], s[1], s[2], alpha, beta, strided, seed ++));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // a few eps per accumulated term is rounding; anything larger is a bug
+    const bool ok = worst < 4;
+    std::printf("gemm %s: max error %.3g eps per term: %s\n", name, worst, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main() {
+    const bool ok_f = run<float>("float");
+    const bool ok_d = run<double>("double");
+    return ok_f && ok_d ? 0 : 1;
+}
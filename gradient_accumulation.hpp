@@ -0,0 +1,126 @@
+#ifndef GRADIENT_ACCUMULATION_H
+#define GRADIENT_ACCUMULATION_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+#include "nn.hpp"
+#include "optimizer.hpp"
+
+namespace neural_network {
+
+    struct Accumulation_Options {
+        // rows behind each optimizer step
+        size_t logical_batch_size = 65536;
+        // bytes the workspace of one micro-batch may take: activations and saved tensors of the
+        // forward, gradients flowing backwards, loss scratch. Parameters, their gradients and the
+        // optimizer state do not depend on the batch and are not counted.
+        size_t memory_budget = size_t(1) << 30;
+    };
+
+    // Runs a logical batch as a sequence of micro-batches, each a forward / backward whose gradients
+    // add to those of the previous ones (Linear_Layer::backward accumulates), then takes one optimizer
+    // step. Only one micro-batch's activations are alive at a time, so the logical batch can be far
+    // larger than what fits in memory at once.
+    //
+    // The micro-batch size comes from the memory budget: the first step starts with a probe of
+    // PROBE_ROWS rows (budgets below what those take are exceeded by the probe alone), the workspace
+    // it used gives the bytes per row, and the rest of the batch runs in the largest micro-batch that
+    // fits the budget. Every workspace buffer is [rows, width] and padded to tensor::ALIGNMENT, so
+    // when rows is a multiple of ALIGNMENT / sizeof(T) no buffer has padding and the workspace is
+    // exactly linear in the rows; micro-batches are rounded down to such a multiple, the workspace
+    // is reserved once at that size and never grows.
+    //
+    // As in Data_Parallel_Trainer, every micro-batch normalizes by the rows of the whole logical
+    // batch, so their gradients add up to its mean gradient and their losses to its mean loss.
+    template <typename T>
+    class Accumulating_Trainer {
+    public:
+        static constexpr size_t PROBE_ROWS = 64;
+
+    private:
+        Neural_Network<T>& model;
+        // not owned; steps the model's parameters
+        Optimizer::Basic_Optimizer<T>& optimizer;
+        Accumulation_Options options;
+        // 0 until the first step has measured the workspace
+        size_t micro_rows = 0;
+        size_t bytes_per_row = 0;
+
+        // forward / backward on top of the gradients so far, as part of a batch of batch_rows rows;
+        // returns the micro-batch's share of the batch loss
+        T _accumulate(tensor::Tensor_View<const T> x, tensor::Tensor_View<const T> target, size_t batch_rows) {
+            T loss = this->model.forward(x, target, batch_rows).second;
+            this->model.backward();
+            return loss;
+        }
+
+        void _plan(size_t probe_rows) {
+            const size_t bytes = this->model.step_workspace_bytes();
+            this->bytes_per_row = (bytes + probe_rows - 1) / probe_rows;
+            size_t rows = this->options.memory_budget / std::max<size_t>(1, this->bytes_per_row);
+            if (rows == 0) {
+                throw std::invalid_argument("The memory budget does not hold the workspace of a single row.");
+            }
+            // below one granule the padding of each buffer may take a few bytes past the budget
+            constexpr size_t granule = std::max<size_t>(1, tensor::ALIGNMENT / sizeof(T));
+            if (rows >= granule) {
+                rows = rows / granule * granule;
+            }
+            this->micro_rows = std::min(rows, this->options.logical_batch_size);
+            this->model.reserve_workspace(this->micro_rows * this->bytes_per_row);
+        }
+
+    public:
+        Accumulating_Trainer(Neural_Network<T>& model, Optimizer::Basic_Optimizer<T>& optimizer, const Accumulation_Options& options = Accumulation_Options()) : model(model), optimizer(optimizer), options(options) {
+            if (options.logical_batch_size == 0) {
+                throw std::invalid_argument("logical_batch_size must be positive.");
+            }
+        }
+
+        // rows per micro-batch; 0 before the first step
+        size_t micro_batch_rows() const {
+            return this->micro_rows;
+        }
+        // workspace bytes one row of a micro-batch takes, as measured by the first step
+        size_t workspace_bytes_per_row() const {
+            return this->bytes_per_row;
+        }
+
+        // one optimizer step on all the rows of x, whatever their number; returns their loss
+        T train_step(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<const T> target) {
+            assert(x_batch.rows == target.rows && "Batch and target must have the same number of rows.");
+            if (x_batch.rows == 0) {
+                return 0;
+            }
+            this->model.zero_grad();
+            T loss = 0;
+            size_t r = 0;
+            if (this->micro_rows == 0) {
+                r = std::min(PROBE_ROWS, x_batch.rows);
+                loss += this->_accumulate(x_batch.slice_rows(0, r), target.slice_rows(0, r), x_batch.rows);
+                this->_plan(r);
+            }
+            for (; r < x_batch.rows; r += this->micro_rows) {
+                const size_t rows = std::min(this->micro_rows, x_batch.rows - r);
+                loss += this->_accumulate(x_batch.slice_rows(r, rows), target.slice_rows(r, rows), x_batch.rows);
+            }
+            this->optimizer.step();
+            return loss;
+        }
+
+        // one step per logical batch of x, in order; returns the mean loss over all the rows
+        T train_epoch(tensor::Tensor_View<const T> x, tensor::Tensor_View<const T> target) {
+            assert(x.rows == target.rows && "Inputs and targets must have the same number of rows.");
+            T loss = 0;
+            for (size_t b = 0; b < x.rows; b += this->options.logical_batch_size) {
+                const size_t rows = std::min(this->options.logical_batch_size, x.rows - b);
+                loss += this->train_step(x.slice_rows(b, rows), target.slice_rows(b, rows)) * static_cast<T>(rows);
+            }
+            return x.rows > 0 ? loss / static_cast<T>(x.rows) : 0;
+        }
+    };
+}
+
+#endif
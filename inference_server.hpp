@@ -0,0 +1,651 @@
+#ifndef INFERENCE_SERVER_H
+#define INFERENCE_SERVER_H
+
+#include <cstdint>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tensor.hpp"
+#include "nn.hpp"
+#include "ops_utils.hpp"
+
+namespace neural_network {
+namespace serving {
+
+    struct Server_Options {
+        // rows per forward pass
+        size_t max_batch_size = 64;
+        // how long the oldest queued request may wait for others to fill its batch
+        std::chrono::microseconds max_wait{500};
+        // rows one Socket_Server request may carry; larger frames close the connection before
+        // anything is allocated for them
+        size_t max_request_rows = 16384;
+    };
+
+    // Latencies in nanoseconds, in 32 linear sub-buckets per power of two: bounded memory for any
+    // number of samples, percentiles within about 3%.
+    class Latency_Histogram {
+    private:
+        static constexpr size_t SUB_BITS = 5;
+        static constexpr size_t SUB = size_t(1) << SUB_BITS;
+
+        std::vector<uint64_t> counts = std::vector<uint64_t>((64 - SUB_BITS + 1) * SUB, 0);
+        uint64_t n = 0;
+        double total = 0;
+        uint64_t largest = 0;
+
+        static size_t _index(uint64_t v) {
+            if (v < SUB) {
+                return static_cast<size_t>(v);
+            }
+            const size_t e = 63 - static_cast<size_t>(__builtin_clzll(v));
+            return (e - SUB_BITS + 1) * SUB + static_cast<size_t>((v >> (e - SUB_BITS)) & (SUB - 1));
+        }
+
+        // middle of bucket i
+        static double _value(size_t i) {
+            if (i < SUB) {
+                return static_cast<double>(i);
+            }
+            const size_t e = i / SUB + SUB_BITS - 1;
+            const double width = static_cast<double>(uint64_t(1) << (e - SUB_BITS));
+            return static_cast<double>(SUB + i % SUB) * width + width / 2;
+        }
+
+    public:
+        void record(uint64_t ns) {
+            this->counts[Latency_Histogram::_index(ns)] += 1;
+            this->n += 1;
+            this->total += static_cast<double>(ns);
+            this->largest = std::max(this->largest, ns);
+        }
+
+        void merge(const Latency_Histogram& other) {
+            for (size_t i = 0; i < this->counts.size(); i ++) {
+                this->counts[i] += other.counts[i];
+            }
+            this->n += other.n;
+            this->total += other.total;
+            this->largest = std::max(this->largest, other.largest);
+        }
+
+        uint64_t count() const {
+            return this->n;
+        }
+        double mean() const {
+            return this->n > 0 ? this->total / this->n : 0;
+        }
+        double max() const {
+            return static_cast<double>(this->largest);
+        }
+        // p in [0, 1]
+        double percentile(double p) const {
+            if (this->n == 0) {
+                return 0;
+            }
+            const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * this->n + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < this->counts.size(); i ++) {
+                seen += this->counts[i];
+                if (seen >= rank) {
+                    return std::min(Latency_Histogram::_value(i), this->max());
+                }
+            }
+            return this->max();
+        }
+    };
+
+    struct Server_Stats {
+        uint64_t requests = 0;
+        uint64_t rows = 0;
+        uint64_t batches = 0;
+        // request latency from submission to answer, in microseconds
+        double p50_us = 0;
+        double p99_us = 0;
+        double mean_us = 0;
+        double max_us = 0;
+        // batch_sizes[n]: forward passes that ran n rows
+        std::vector<uint64_t> batch_sizes;
+
+        double mean_batch_size() const {
+            return this->batches > 0 ? static_cast<double>(this->rows) / this->batches : 0;
+        }
+
+        void print(std::ostream& out) const {
+            out << "requests " << this->requests << ", rows " << this->rows << ", batches " << this->batches
+                << ", mean batch " << this->mean_batch_size() << "\n";
+            out << "latency us: p50 " << this->p50_us << ", p99 " << this->p99_us << ", mean " << this->mean_us << ", max " << this->max_us << "\n";
+            out << "batch size histogram:\n";
+            for (size_t s = 1; s < this->batch_sizes.size(); s ++) {
+                if (this->batch_sizes[s] > 0) {
+                    out << "  " << s << ": " << this->batch_sizes[s] << "\n";
+                }
+            }
+        }
+    };
+
+    // In-process dynamic batching in front of a trained model, which must outlive the server.
+    //
+    // Callers on any number of threads submit rows with infer(); a single batching thread queues
+    // them, waits until either max_batch_size rows are pending or the oldest request has waited
+    // max_wait, runs the batch through one no-grad forward (the weights are streamed once for the
+    // whole batch instead of once per request, and the GEMMs themselves use the thread pool) and
+    // copies every request's logits back before waking it. A request larger than max_batch_size is
+    // split across consecutive batches.
+    template <typename T>
+    class Inference_Server {
+    private:
+        struct Request {
+            tensor::Tensor_View<const T> x;
+            tensor::Tensor_View<T> logits;
+            // first row not yet taken into a batch, rows not yet answered
+            size_t next_row = 0;
+            size_t remaining = 0;
+            std::chrono::steady_clock::time_point submitted;
+            std::condition_variable done;
+        };
+        struct Piece {
+            Request* request;
+            size_t row;
+            size_t count;
+        };
+
+        const Neural_Network<T>& model;
+        Server_Options options;
+        size_t n_features;
+        size_t n_outputs;
+
+        mutable std::mutex mutex;
+        std::condition_variable queued;
+        std::deque<Request*> queue;
+        size_t queued_rows = 0;
+        bool stop = false;
+
+        // owned by the batching thread
+        tensor::Tensor<T> batch;
+        Inference_Buffers<T> buffers;
+        std::vector<Piece> pieces;
+
+        // guarded by mutex
+        Latency_Histogram latency;
+        std::vector<uint64_t> batch_sizes;
+        uint64_t n_requests = 0;
+        uint64_t n_rows = 0;
+        uint64_t n_batches = 0;
+
+        std::thread worker;
+
+        void _batch_loop() {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            while (true) {
+                this->queued.wait(lock, [&] { return this->stop || this->queued_rows > 0; });
+                if (this->queued_rows == 0) {
+                    // stopping, and every request has been answered
+                    return;
+                }
+                const auto deadline = this->queue.front()->submitted + this->options.max_wait;
+                this->queued.wait_until(lock, deadline, [&] { return this->stop || this->queued_rows >= this->options.max_batch_size; });
+
+                // oldest rows first
+                this->pieces.clear();
+                size_t rows = 0;
+                while (rows < this->options.max_batch_size && !this->queue.empty()) {
+                    Request* r = this->queue.front();
+                    const size_t take = std::min(this->options.max_batch_size - rows, r->x.rows - r->next_row);
+                    this->pieces.push_back(Piece{r, r->next_row, take});
+                    r->next_row += take;
+                    rows += take;
+                    if (r->next_row == r->x.rows) {
+                        this->queue.pop_front();
+                    }
+                }
+                this->queued_rows -= rows;
+                lock.unlock();
+
+                this->batch.resize(rows, this->n_features);
+                size_t offset = 0;
+                for (const Piece& p : this->pieces) {
+                    this->batch.view().slice_rows(offset, p.count).copy_from(p.request->x.slice_rows(p.row, p.count));
+                    offset += p.count;
+                }
+                tensor::Tensor_View<const T> logits = this->model.infer_logits(this->batch.view(), this->buffers);
+                offset = 0;
+                for (const Piece& p : this->pieces) {
+                    p.request->logits.slice_rows(p.row, p.count).copy_from(logits.slice_rows(offset, p.count));
+                    offset += p.count;
+                }
+                const auto now = std::chrono::steady_clock::now();
+
+                lock.lock();
+                this->n_batches += 1;
+                this->n_rows += rows;
+                this->batch_sizes[rows] += 1;
+                for (const Piece& p : this->pieces) {
+                    Request* r = p.request;
+                    r->remaining -= p.count;
+                    if (r->remaining == 0) {
+                        this->n_requests += 1;
+                        this->latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - r->submitted).count()));
+                        // the caller cannot return, and destroy r, before the lock is released
+                        r->done.notify_one();
+                    }
+                }
+            }
+        }
+
+    public:
+        Inference_Server(const Neural_Network<T>& model, const Server_Options& options = Server_Options()) : model(model), options(options) {
+            if (options.max_batch_size == 0) {
+                throw std::invalid_argument("max_batch_size must be positive.");
+            }
+            const std::valarray<int>& dims = model.get_num_dims();
+            this->n_features = static_cast<size_t>(dims[0]);
+            this->n_outputs = static_cast<size_t>(dims[dims.size() - 1]);
+            this->batch = tensor::Tensor<T>(options.max_batch_size, this->n_features);
+            this->pieces.reserve(options.max_batch_size);
+            this->batch_sizes.assign(options.max_batch_size + 1, 0);
+            this->worker = std::thread(&Inference_Server::_batch_loop, this);
+        }
+
+        Inference_Server(const Inference_Server&) = delete;
+        Inference_Server& operator=(const Inference_Server&) = delete;
+
+        // answers every request already queued, then stops
+        ~Inference_Server() {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stop = true;
+            }
+            this->queued.notify_all();
+            this->worker.join();
+        }
+
+        size_t num_features() const {
+            return this->n_features;
+        }
+        size_t num_outputs() const {
+            return this->n_outputs;
+        }
+        const Server_Options& get_options() const {
+            return this->options;
+        }
+
+        // x [rows, num_features()] -> logits [rows, num_outputs()]; blocks until answered, safe to
+        // call from any number of threads
+        void infer(tensor::Tensor_View<const T> x, tensor::Tensor_View<T> logits) {
+            if (x.cols != this->n_features || logits.rows != x.rows || logits.cols != this->n_outputs) {
+                throw std::invalid_argument("Request does not match the model's input or output width.");
+            }
+            if (x.rows == 0) {
+                return;
+            }
+            Request r;
+            r.x = x;
+            r.logits = logits;
+            r.remaining = x.rows;
+            std::unique_lock<std::mutex> lock(this->mutex);
+            r.submitted = std::chrono::steady_clock::now();
+            this->queue.push_back(&r);
+            this->queued_rows += x.rows;
+            if (this->queued_rows >= this->options.max_batch_size || this->queue.size() == 1) {
+                this->queued.notify_one();
+            }
+            r.done.wait(lock, [&] { return r.remaining == 0; });
+        }
+
+        // class of a single sample of num_features() values
+        size_t predict(const T* features) {
+            thread_local tensor::Tensor<T> logits;
+            logits.resize(1, this->n_outputs);
+            this->infer(tensor::Tensor_View<const T>(features, 1, this->n_features), logits.view());
+            return ops_utils::find_max_and_argmax(logits.data(), this->n_outputs).second;
+        }
+
+        Server_Stats stats() const {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            Server_Stats s;
+            s.requests = this->n_requests;
+            s.rows = this->n_rows;
+            s.batches = this->n_batches;
+            s.p50_us = this->latency.percentile(0.50) / 1e3;
+            s.p99_us = this->latency.percentile(0.99) / 1e3;
+            s.mean_us = this->latency.mean() / 1e3;
+            s.max_us = this->latency.max() / 1e3;
+            s.batch_sizes = this->batch_sizes;
+            return s;
+        }
+
+        void reset_stats() {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->latency = Latency_Histogram();
+            std::fill(this->batch_sizes.begin(), this->batch_sizes.end(), 0);
+            this->n_requests = 0;
+            this->n_rows = 0;
+            this->n_batches = 0;
+        }
+    };
+
+    // Wire format over the Unix socket, both directions: a Frame_Header followed by rows x cols
+    // values of the header's dtype, row-major. A request carries features, the answer the logits;
+    // a malformed request, or one of more than Server_Options::max_request_rows rows, closes the
+    // connection.
+    struct Frame_Header {
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t dtype;
+        uint32_t reserved;
+    };
+
+    namespace detail {
+        inline bool read_all(int fd, void* data, size_t bytes) {
+            char* p = static_cast<char*>(data);
+            while (bytes > 0) {
+                ssize_t n = ::recv(fd, p, bytes, 0);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                p += n;
+                bytes -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        inline bool write_all(int fd, const void* data, size_t bytes) {
+            const char* p = static_cast<const char*>(data);
+            while (bytes > 0) {
+                ssize_t n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    return false;
+                }
+                p += n;
+                bytes -= static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        inline sockaddr_un socket_address(const std::string& path) {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path)) {
+                throw std::invalid_argument("Socket path too long: " + path);
+            }
+            std::copy(path.begin(), path.end(), addr.sun_path);
+            return addr;
+        }
+    }
+
+    // Serves an Inference_Server on a Unix domain socket, one thread per connection (joined on the
+    // next accept once its client hangs up); every row of every connection goes through the same
+    // dynamic batches. Removes the socket file on exit.
+    template <typename T>
+    class Socket_Server {
+    private:
+        Inference_Server<T>& server;
+        std::string path;
+        int listen_fd = -1;
+        std::atomic<bool> stop{false};
+        std::thread acceptor;
+        std::mutex mutex;
+        std::vector<int> connections;
+        std::vector<std::thread> handlers;
+        // handlers that have returned from _serve, joined on the next accept
+        std::vector<std::thread::id> finished;
+
+        // with mutex held
+        void _reap_finished() {
+            for (std::thread::id id : this->finished) {
+                auto it = std::find_if(this->handlers.begin(), this->handlers.end(), [&](const std::thread& t) { return t.get_id() == id; });
+                it->join();
+                this->handlers.erase(it);
+            }
+            this->finished.clear();
+        }
+
+        void _accept_loop() {
+            while (true) {
+                int fd = ::accept(this->listen_fd, nullptr, nullptr);
+                if (fd < 0) {
+                    if (errno == EINTR && !this->stop.load()) {
+                        continue;
+                    }
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (this->stop.load()) {
+                    ::close(fd);
+                    return;
+                }
+                this->_reap_finished();
+                this->connections.push_back(fd);
+                this->handlers.emplace_back(&Socket_Server::_serve, this, fd);
+            }
+        }
+
+        void _serve(int fd) {
+            // anything thrown here, e.g std::bad_alloc, only ends this connection
+            try {
+                tensor::Tensor<T> x;
+                tensor::Tensor<T> logits;
+                Frame_Header header;
+                while (detail::read_all(fd, &header, sizeof(header))) {
+                    if (header.cols != this->server.num_features() || header.dtype != static_cast<uint32_t>(tensor::dtype_of<T>()) || header.rows > this->server.get_options().max_request_rows) {
+                        break;
+                    }
+                    x.resize(header.rows, header.cols);
+                    if (!detail::read_all(fd, x.data(), x.size() * sizeof(T))) {
+                        break;
+                    }
+                    logits.resize(header.rows, this->server.num_outputs());
+                    this->server.infer(x.view(), logits.view());
+                    Frame_Header answer = {header.rows, static_cast<uint32_t>(logits.cols()), header.dtype, 0};
+                    if (!detail::write_all(fd, &answer, sizeof(answer)) || !detail::write_all(fd, logits.data(), logits.size() * sizeof(T))) {
+                        break;
+                    }
+                }
+            } catch (const std::exception&) {
+            }
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->connections.erase(std::find(this->connections.begin(), this->connections.end(), fd));
+            ::close(fd);
+            this->finished.push_back(std::this_thread::get_id());
+        }
+
+    public:
+        Socket_Server(Inference_Server<T>& server, const std::string& path) : server(server), path(path) {
+            sockaddr_un addr = detail::socket_address(path);
+            this->listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (this->listen_fd < 0) {
+                throw std::runtime_error("Unable to create socket: " + path);
+            }
+            ::unlink(path.c_str());
+            if (::bind(this->listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(this->listen_fd, 128) != 0) {
+                ::close(this->listen_fd);
+                throw std::runtime_error("Unable to listen on socket: " + path);
+            }
+            this->acceptor = std::thread(&Socket_Server::_accept_loop, this);
+        }
+
+        Socket_Server(const Socket_Server&) = delete;
+        Socket_Server& operator=(const Socket_Server&) = delete;
+
+        ~Socket_Server() {
+            this->stop.store(true);
+            ::shutdown(this->listen_fd, SHUT_RDWR);
+            this->acceptor.join();
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                for (int fd : this->connections) {
+                    ::shutdown(fd, SHUT_RDWR);
+                }
+            }
+            for (std::thread& t : this->handlers) {
+                t.join();
+            }
+            ::close(this->listen_fd);
+            ::unlink(this->path.c_str());
+        }
+    };
+
+    // one connection to a Socket_Server; not thread-safe, open one per thread
+    template <typename T>
+    class Socket_Client {
+    private:
+        int fd = -1;
+
+    public:
+        explicit Socket_Client(const std::string& path) {
+            sockaddr_un addr = detail::socket_address(path);
+            this->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (this->fd < 0 || ::connect(this->fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+                if (this->fd >= 0) {
+                    ::close(this->fd);
+                }
+                throw std::runtime_error("Unable to connect to socket: " + path);
+            }
+        }
+
+        Socket_Client(const Socket_Client&) = delete;
+        Socket_Client& operator=(const Socket_Client&) = delete;
+
+        Socket_Client(Socket_Client&& other) noexcept {
+            std::swap(this->fd, other.fd);
+        }
+
+        ~Socket_Client() {
+            if (this->fd >= 0) {
+                ::close(this->fd);
+            }
+        }
+
+        // logits is resized to [x.rows, outputs]; throws std::runtime_error if the server hangs up
+        void infer(tensor::Tensor_View<const T> x, tensor::Tensor<T>& logits) {
+            Frame_Header header = {static_cast<uint32_t>(x.rows), static_cast<uint32_t>(x.cols), static_cast<uint32_t>(tensor::dtype_of<T>()), 0};
+            bool ok = detail::write_all(this->fd, &header, sizeof(header));
+            for (size_t i = 0; ok && i < x.rows; i ++) {
+                ok = detail::write_all(this->fd, x.row(i), x.cols * sizeof(T));
+            }
+            ok = ok && detail::read_all(this->fd, &header, sizeof(header)) && header.rows == x.rows;
+            if (ok) {
+                logits.resize(header.rows, header.cols);
+                ok = detail::read_all(this->fd, logits.data(), logits.size() * sizeof(T));
+            }
+            if (!ok) {
+                throw std::runtime_error("Inference request failed: connection closed by the server.");
+            }
+        }
+    };
+
+    struct Load_Options {
+        // concurrent clients, each sending its requests back to back
+        size_t num_clients = 8;
+        size_t requests_per_client = 1000;
+        size_t rows_per_request = 1;
+    };
+
+    struct Load_Report {
+        uint64_t requests = 0;
+        double seconds = 0;
+        double requests_per_second = 0;
+        // as seen by the clients, in microseconds
+        double p50_us = 0;
+        double p99_us = 0;
+
+        void print(std::ostream& out) const {
+            out << this->requests << " requests in " << this->seconds << " s: " << this->requests_per_second << " req/s, client latency us: p50 "
+                << this->p50_us << ", p99 " << this->p99_us << "\n";
+        }
+    };
+
+    namespace detail {
+        // make_client() runs on each client thread and returns a callable (x, logits tensor)
+        template <typename T, typename Make_Client>
+        Load_Report run_load(tensor::Tensor_View<const T> inputs, const Load_Options& options, Make_Client make_client) {
+            if (options.rows_per_request == 0 || options.rows_per_request > inputs.rows) {
+                throw std::invalid_argument("rows_per_request must be between 1 and the number of input rows.");
+            }
+            Latency_Histogram latency;
+            std::mutex mutex;
+            std::vector<std::thread> clients;
+            const size_t starts = inputs.rows - options.rows_per_request + 1;
+            const auto t0 = std::chrono::steady_clock::now();
+            for (size_t c = 0; c < options.num_clients; c ++) {
+                clients.emplace_back([&, c] {
+                    auto infer = make_client();
+                    tensor::Tensor<T> logits;
+                    Latency_Histogram local;
+                    for (size_t r = 0; r < options.requests_per_client; r ++) {
+                        const size_t begin = ((c * options.requests_per_client + r) * options.rows_per_request) % starts;
+                        const auto s = std::chrono::steady_clock::now();
+                        infer(inputs.slice_rows(begin, options.rows_per_request), logits);
+                        local.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s).count()));
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    latency.merge(local);
+                });
+            }
+            for (std::thread& t : clients) {
+                t.join();
+            }
+            Load_Report report;
+            report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            report.requests = latency.count();
+            report.requests_per_second = report.requests / report.seconds;
+            report.p50_us = latency.percentile(0.50) / 1e3;
+            report.p99_us = latency.percentile(0.99) / 1e3;
+            return report;
+        }
+    }
+
+    // load generator for the in-process API; requests cycle through the rows of inputs
+    template <typename T>
+    Load_Report run_load(Inference_Server<T>& server, tensor::Const_View<T> inputs, const Load_Options& options = Load_Options()) {
+        return detail::run_load<T>(inputs, options, [&server] {
+            return [&server](tensor::Tensor_View<const T> x, tensor::Tensor<T>& logits) {
+                logits.resize(x.rows, server.num_outputs());
+                server.infer(x, logits.view());
+            };
+        });
+    }
+
+    // load generator over the socket, one connection per client
+    template <typename T>
+    Load_Report run_load(const std::string& socket_path, tensor::Tensor_View<const T> inputs, const Load_Options& options = Load_Options()) {
+        return detail::run_load<T>(inputs, options, [&socket_path] {
+            return [client = Socket_Client<T>(socket_path)](tensor::Tensor_View<const T> x, tensor::Tensor<T>& logits) mutable {
+                client.infer(x, logits);
+            };
+        });
+    }
+
+    // the same for a mutable view, e.g ds.features.view(); T can only come from inputs here
+    template <typename T>
+    Load_Report run_load(const std::string& socket_path, tensor::Tensor_View<T> inputs, const Load_Options& options = Load_Options()) {
+        using U = std::remove_const_t<T>;
+        return serving::run_load<U>(socket_path, tensor::Tensor_View<const U>(inputs), options);
+    }
+}
+}
+
+#endif
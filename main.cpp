@@ -6,15 +6,15 @@ int main() {
     std::string archi = "linear-sigmoid-linear";
     std::valarray<int> num_dims = {2, 3, 1};
     neural_network::Neural_Network<double> nn(archi, num_dims);
-    std::vector<std::valarray<double>> X = ops_utils::init_matrix::generate_uniform_matrix<double>(3, 2);
-    std::valarray<double> x1 = ops_utils::reduced_sum<double>(X, 0);
-    std::valarray<double> x2 = ops_utils::reduced_sum<double>(X, 1);
+    tensor::Tensor<double> X = ops_utils::init_matrix::generate_uniform_matrix<double>(3, 2);
+    tensor::Tensor<double> x1 = ops_utils::reduced_sum<double>(X, 0);
+    tensor::Tensor<double> x2 = ops_utils::reduced_sum<double>(X, 1);
 
-    ops_utils::print_2D_matrix(X);
+    ops_utils::print_2D_matrix<double>(X);
     std::cout << std::endl;
-    ops_utils::print_2D_matrix(x1);
+    ops_utils::print_2D_matrix<double>(x1);
     std::cout << std::endl;
-    ops_utils::print_2D_matrix(x2);
+    ops_utils::print_2D_matrix<double>(x2);
 
     return 0;
 }
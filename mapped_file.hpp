@@ -0,0 +1,113 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io {
+
+    enum class Access {
+        Read_Only,
+        // writable, but writes go to private copies of the touched pages and never reach the file
+        Copy_On_Write
+    };
+
+    // memory mapping of a whole file. Pages come straight from the page cache, so several
+    // processes mapping the same file share them (until a copy-on-write mapping writes to one).
+    class Mapped_File {
+    private:
+        const char* ptr = nullptr;
+        size_t n_bytes = 0;
+
+        void _unmap() {
+            if (this->ptr != nullptr) {
+                munmap(const_cast<char*>(this->ptr), this->n_bytes);
+            }
+            this->ptr = nullptr;
+            this->n_bytes = 0;
+        }
+
+    public:
+        Mapped_File() = default;
+
+        explicit Mapped_File(const std::string& file_name, Access access = Access::Read_Only) {
+            int fd = open(file_name.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("Unable to open file: " + file_name);
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                throw std::runtime_error("Unable to stat file: " + file_name);
+            }
+            this->n_bytes = static_cast<size_t>(st.st_size);
+            if (this->n_bytes > 0) {
+                void* p = access == Access::Read_Only ? mmap(nullptr, this->n_bytes, PROT_READ, MAP_SHARED, fd, 0)
+                                                      : mmap(nullptr, this->n_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    close(fd);
+                    throw std::runtime_error("Unable to map file: " + file_name);
+                }
+                this->ptr = static_cast<const char*>(p);
+            }
+            // the mapping keeps its own reference to the file
+            close(fd);
+        }
+
+        Mapped_File(const Mapped_File&) = delete;
+        Mapped_File& operator=(const Mapped_File&) = delete;
+
+        Mapped_File(Mapped_File&& other) noexcept {
+            std::swap(this->ptr, other.ptr);
+            std::swap(this->n_bytes, other.n_bytes);
+        }
+
+        Mapped_File& operator=(Mapped_File&& other) noexcept {
+            if (this != &other) {
+                this->_unmap();
+                std::swap(this->ptr, other.ptr);
+                std::swap(this->n_bytes, other.n_bytes);
+            }
+            return *this;
+        }
+
+        ~Mapped_File() {
+            this->_unmap();
+        }
+
+        // access pattern hints for the kernel's read-ahead
+        void advise_sequential() const {
+            if (this->ptr != nullptr) {
+                madvise(const_cast<char*>(this->ptr), this->n_bytes, MADV_SEQUENTIAL);
+            }
+        }
+        void advise_random() const {
+            if (this->ptr != nullptr) {
+                madvise(const_cast<char*>(this->ptr), this->n_bytes, MADV_RANDOM);
+            }
+        }
+
+        const char* data() const {
+            return this->ptr;
+        }
+        // only for Copy_On_Write mappings
+        char* mutable_data() const {
+            return const_cast<char*>(this->ptr);
+        }
+        size_t size() const {
+            return this->n_bytes;
+        }
+        bool empty() const {
+            return this->n_bytes == 0;
+        }
+    };
+}
+
+#endif
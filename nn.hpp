@@ -1,3 +1,6 @@
+#ifndef NN_H
+#define NN_H
+
 #include <valarray>
 #include <vector>
 #include <string>
@@ -8,19 +11,27 @@
 #include <stdexcept>
 #include <cassert>
 #include <sstream>
+#include <algorithm>
 
 
 #include "optimizer.hpp"
 
 namespace neural_network {
 
+    // the two activation buffers of the no-grad path; a caller that runs inference concurrently
+    // with others keeps its own pair
+    template <typename T>
+    struct Inference_Buffers {
+        tensor::Tensor<T> ping;
+        tensor::Tensor<T> pong;
+    };
+
     template<typename T>
     class Neural_Network {
     private:
 
         std::string architecture_name;
         std::valarray<int> num_dims;
-        std::vector<std::valarray<T>> layers_weight;
         std::vector<std::string> layers_name;
         std::vector<std::unique_ptr<Block::Basic_Block<T>>> layer_objects;
 
@@ -28,17 +39,116 @@ namespace neural_network {
 
         std::unique_ptr<Block::Loss_Function::Cross_Entropy_Loss<T>> loss_function;
 
-        bool _check_validity(std::vector<std::string> arch_layers) {
-            // to be implementing
-            return true;
+        // activations, saved tensors and gradients of the current step; reset when the next one starts
+        workspace::Arena arena;
+        // Checkpointing (empty when off): the first block of every segment and, once forward has run,
+        // the input each segment starts from. Only those inputs and the logits stay in `arena`; the
+        // activations inside a segment go to segment_arena and are recomputed by backward, which
+        // hands the gradient from one segment to the next through segment_grad[s % 2].
+        std::vector<size_t> segment_begin;
+        std::vector<tensor::Tensor_View<const T>> segment_input;
+        workspace::Arena segment_arena;
+        tensor::Tensor<T> segment_grad[2];
+        // most the segment arena held at once during the current step
+        size_t segment_peak = 0;
+        // used by predict
+        Inference_Buffers<T> infer_buffers;
+        // set once parameter_arena() has flattened the parameters
+        std::unique_ptr<Optimizer::Parameter_Arena<T>> parameters;
+
+        // one past the last block of segment s
+        size_t _segment_end(size_t s) const {
+            return s + 1 < this->segment_begin.size() ? this->segment_begin[s + 1] : this->layer_objects.size();
+        }
+
+        // Upper bound of what a step on batch_rows rows allocates: cost[i] for block i, its output in
+        // forward and in backward a gradient for its input and one for its output; inp[i] and out[i]
+        // its input and output; loss the gradient of the logits, written by the loss forward
+        struct Block_Costs {
+            std::vector<size_t> cost;
+            std::vector<size_t> inp;
+            std::vector<size_t> out;
+            size_t loss = 0;
+        };
+
+        Block_Costs _block_costs(size_t batch_rows) const {
+            const size_t L = this->layer_objects.size();
+            auto buffer = [&](size_t cols) {
+                return (batch_rows * cols * sizeof(T) + tensor::ALIGNMENT - 1) / tensor::ALIGNMENT * tensor::ALIGNMENT;
+            };
+            Block_Costs c;
+            c.cost.resize(L);
+            c.inp.resize(L);
+            c.out.resize(L);
+            size_t cols = static_cast<size_t>(this->num_dims[0]);
+            for (size_t i = 0; i < L; i ++) {
+                const size_t out_cols = this->layer_objects[i]->output_cols(cols);
+                c.inp[i] = buffer(cols);
+                c.out[i] = buffer(out_cols);
+                c.cost[i] = 2 * c.out[i] + c.inp[i];
+                cols = out_cols;
+            }
+            c.loss = buffer(cols);
+            return c;
         }
 
-        std::unique_ptr<Block::Basic_Block<T>> _create_layer(const std::string& layer_name, int out_dim = 0, int inp_dim = 0) {
+        // what the segments starting at `begin` take: checkpoints and the logits' gradient in the main
+        // arena, the largest segment in the segment arena, and the two buffers the gradients are handed
+        // between segments through, segment s > 0 writing into buffer s % 2
+        void _segment_bytes(const Block_Costs& c, const std::vector<size_t>& begin, size_t& main, size_t& segment, size_t& grad) const {
+            main = c.loss;
+            segment = 0;
+            size_t handoff[2] = {0, 0};
+            for (size_t s = 0; s < begin.size(); s ++) {
+                const size_t end = s + 1 < begin.size() ? begin[s + 1] : this->layer_objects.size();
+                main += c.out[end - 1];
+                size_t seg_cost = 0;
+                for (size_t i = begin[s]; i < end; i ++) {
+                    seg_cost += c.cost[i];
+                }
+                segment = std::max(segment, seg_cost);
+                if (s > 0) {
+                    handoff[s % 2] = std::max(handoff[s % 2], c.inp[begin[s]]);
+                }
+            }
+            grad = handoff[0] + handoff[1];
+        }
+
+        // every "linear" takes its input and output sizes from consecutive entries of num_dims
+        void _check_validity(const std::vector<std::string>& arch_layers, const std::valarray<int>& num_dims) {
+            size_t n_linear = 0;
+            for (const auto& x : arch_layers) {
+                if (x == "linear") {
+                    n_linear += 1;
+                }
+            }
+            if (num_dims.size() != n_linear + 1) {
+                throw std::invalid_argument("num_dims must have one more entry than the architecture has linear layers");
+            }
+            for (size_t i = 0; i < num_dims.size(); i ++) {
+                if (num_dims[i] <= 0) {
+                    throw std::invalid_argument("num_dims must be positive");
+                }
+            }
+        }
+
+        std::unique_ptr<Block::Basic_Block<T>> _create_layer(const std::string& layer_name, int out_dim = 0, int inp_dim = 0, bool initialize = true) {
             if (layer_name == "linear") {
                 if (out_dim <= 0 || inp_dim <= 0) {
                     throw std::invalid_argument("out_dim and inp_dim must be positive for Linear_Layer");
                 }
-                return std::make_unique<Block::Layer::Linear_Layer<T>>(out_dim, inp_dim);
+                return std::make_unique<Block::Layer::Linear_Layer<T>>(out_dim, inp_dim, initialize);
+            } else if (layer_name == "linear-relu" || layer_name == "linear-sigmoid" || layer_name == "linear-tanh") {
+                if (out_dim <= 0 || inp_dim <= 0) {
+                    throw std::invalid_argument("out_dim and inp_dim must be positive for Linear_Activation_Layer");
+                }
+                act_kernels::Activation activation = act_kernels::Activation::ReLU;
+                if (layer_name == "linear-sigmoid") {
+                    activation = act_kernels::Activation::Sigmoid;
+                } else if (layer_name == "linear-tanh") {
+                    activation = act_kernels::Activation::Tanh;
+                }
+                return std::make_unique<Block::Layer::Linear_Activation_Layer<T>>(out_dim, inp_dim, activation, initialize);
             } else if (layer_name == "relu") {
                 return std::make_unique<Block::Layer::ReLU<T>>();
             } else if (layer_name == "sigmoid") {
@@ -50,11 +160,26 @@ namespace neural_network {
             }
         }
 
-        void _make_model() {
+        // merges every "linear" directly followed by an activation into a single "linear-<act>" block
+        std::vector<std::string> _fuse_layers(const std::vector<std::string>& names) {
+            std::vector<std::string> fused;
+            for (size_t i = 0; i < names.size(); i ++) {
+                if (names[i] == "linear" && i + 1 < names.size() && (names[i + 1] == "relu" || names[i + 1] == "sigmoid" || names[i + 1] == "tanh")) {
+                    fused.push_back(names[i] + "-" + names[i + 1]);
+                    i += 1;
+                }
+                else {
+                    fused.push_back(names[i]);
+                }
+            }
+            return fused;
+        }
+
+        void _make_model(bool initialize) {
             int cnt = 0;
-            for (const auto& x : layers_name) {
-                if (x == "linear") {
-                    this->layer_objects.push_back(_create_layer(x, this->num_dims[cnt+1], this->num_dims[cnt]));
+            for (const auto& x : _fuse_layers(layers_name)) {
+                if (x.rfind("linear", 0) == 0) {
+                    this->layer_objects.push_back(_create_layer(x, this->num_dims[cnt+1], this->num_dims[cnt], initialize));
                     cnt += 1;
                 }
                 else {
@@ -64,9 +189,47 @@ namespace neural_network {
             this->loss_function = std::make_unique<Block::Loss_Function::Cross_Entropy_Loss<T>>();
         }
 
+        // the no-grad forward behind infer_logits; observe(i, input) sees the input of block i before it runs
+        template <typename Observer>
+        tensor::Tensor_View<const T> _infer(tensor::Tensor_View<const T> x_batch, Inference_Buffers<T>& buffers, const Observer& observe) const {
+            // even layers write to ping, odd ones to pong
+            size_t width[2] = {0, 0};
+            size_t cols = x_batch.cols;
+            for (size_t i = 0; i < layer_objects.size(); i ++) {
+                cols = layer_objects[i]->output_cols(cols);
+                width[i % 2] = std::max(width[i % 2], cols);
+            }
+            buffers.ping.resize(x_batch.rows, width[0]);
+            buffers.pong.resize(x_batch.rows, width[1]);
+
+            tensor::Tensor_View<const T> output = x_batch;
+            for (size_t i = 0; i < layer_objects.size(); i ++) {
+                T* data = i % 2 == 0 ? buffers.ping.data() : buffers.pong.data();
+                tensor::Tensor_View<T> next(data, x_batch.rows, layer_objects[i]->output_cols(output.cols));
+                observe(i, output);
+                layer_objects[i]->infer(output, next);
+                output = next;
+            }
+            return output;
+        }
+
     public:
 
-        Neural_Network(std::string architecture, std::valarray<int> num_dims) {
+        // replica with its own layers, parameters, gradients and workspace
+        Neural_Network(const Neural_Network& other) {
+            this->architecture_name = other.architecture_name;
+            this->num_dims = other.num_dims;
+            this->layers_name = other.layers_name;
+            for (const auto& layer : other.layer_objects) {
+                this->layer_objects.push_back(layer->clone());
+            }
+            this->segment_begin = other.segment_begin;
+            this->loss_function = std::make_unique<Block::Loss_Function::Cross_Entropy_Loss<T>>();
+        }
+
+        // initialize = false skips the weight initialization and leaves every W and b empty, for a
+        // checkpoint to fill in
+        Neural_Network(std::string architecture, std::valarray<int> num_dims, bool initialize = true) {
             std::vector<std::string> arch_layers;
 
             std::string layer;
@@ -75,47 +238,333 @@ namespace neural_network {
                 arch_layers.push_back(layer);
             }
 
-            assert(_check_validity(arch_layers) && "Architecture must be valid.");
+            _check_validity(arch_layers, num_dims);
             this->layers_name = arch_layers;
             this->num_dims = num_dims;
 
-            this->_make_model();
+            this->_make_model(initialize);
 
             // this->optimizer = std::make_unique<Optimizer::Gradient_Descent<T>>();
         }
 
-        std::vector<std::valarray<T>> forward_logits(const std::vector<std::valarray<T>>& x_batch) {
-            std::vector<std::valarray<T>> output = x_batch;
-            for(int i = 0; i < layer_objects.size(); i ++) {
-                output = layer_objects[i]->forward(output);
+        // starts a new step: every view handed out by the previous forward / backward becomes invalid.
+        // The returned logits live in the workspace; x_batch is referenced, not copied, so it has to
+        // stay alive until backward() has run.
+        tensor::Tensor_View<const T> forward_logits(tensor::Tensor_View<const T> x_batch) {
+            this->arena.reset();
+            tensor::Tensor_View<const T> output = x_batch;
+            if (this->segment_begin.empty()) {
+                for(size_t i = 0; i < layer_objects.size(); i ++) {
+                    output = layer_objects[i]->forward(output, this->arena);
+                }
+                return output;
+            }
+            this->segment_input.clear();
+            this->segment_peak = 0;
+            for (size_t s = 0; s < this->segment_begin.size(); s ++) {
+                this->segment_arena.reset();
+                this->segment_input.push_back(output);
+                const size_t end = this->_segment_end(s);
+                for (size_t i = this->segment_begin[s]; i < end; i ++) {
+                    // the output of a segment is the next one's checkpoint
+                    output = layer_objects[i]->forward(output, i + 1 == end ? this->arena : this->segment_arena);
+                }
+                this->segment_peak = std::max(this->segment_peak, this->segment_arena.bytes_in_use());
             }
             return output;
         }
 
-        std::vector<T> predict(const std::vector<std::valarray<T>>& x_batch) {
-            std::vector<std::valarray<T>> logits = this->forward_logits(x_batch);
+        // No-grad forward for inference: no block saves anything for backward, and instead of one
+        // workspace block per layer the activations ping-pong between the two buffers, each sized
+        // (once, then reused) for the widest layer writing into it. The logits live in `buffers`
+        // until its next use.
+        tensor::Tensor_View<const T> infer_logits(tensor::Tensor_View<const T> x_batch, Inference_Buffers<T>& buffers) const {
+            return this->_infer(x_batch, buffers, [](size_t, tensor::Tensor_View<const T>) {});
+        }
+
+        tensor::Tensor_View<const T> infer_logits(tensor::Tensor_View<const T> x_batch) {
+            return this->infer_logits(x_batch, this->infer_buffers);
+        }
+
+        std::vector<T> predict(tensor::Tensor_View<const T> x_batch, Inference_Buffers<T>& buffers) const {
+            tensor::Tensor_View<const T> logits = this->infer_logits(x_batch, buffers);
             std::vector<T> res;
-            for (int i = 0; i < logits.size(); i ++) {
-                std::pair<T, std::size_t> a = find_max_and_argmax(x_batch[i]);
+            for (size_t i = 0; i < logits.rows; i ++) {
+                std::pair<T, std::size_t> a = ops_utils::find_max_and_argmax(logits.row(i), logits.cols);
                 std::size_t max_index = a.second;
                 res.push_back(max_index);
             }
             return res;
         }
 
-        std::pair<std::vector<std::valarray<T>>, T> forward(const std::vector<std::valarray<T>>& x_batch, const std::vector<std::valarray<T>>& target) {
-            std::vector<std::valarray<T>> logits = this->forward_logits(x_batch);
-            T loss = this->loss_function(logits, target);
-            return std::make_pair<logits, loss>;
+        std::vector<T> predict(tensor::Tensor_View<const T> x_batch) {
+            return this->predict(x_batch, this->infer_buffers);
+        }
+
+        // target: [N, C] class distributions or [N, 1] class labels. The loss (and the gradient
+        // backward() starts from) is the sum over the rows divided by normalizer, by default the rows
+        // of x_batch; a piece of a larger batch passes the rows of the whole batch.
+        std::pair<tensor::Tensor_View<const T>, T> forward(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<const T> target, size_t normalizer = 0) {
+            tensor::Tensor_View<const T> logits = this->forward_logits(x_batch);
+            T loss = this->loss_function->forward(logits, target, this->arena, normalizer);
+            return std::make_pair(logits, loss);
         }
 
 
-        void backward() {
-            std::vector<std::valarray<T>> dX = this->loss_function->backward();
-            for(int i = layer_objects.size() - 1; i >= 0; i --) {
-                dX = layer_objects[i]->backward(dX);
+        // returns the gradient w.r.t. the x_batch of the last forward, e.g for a layer in front of the
+        // network; it lives in the workspace until the next forward
+        tensor::Tensor_View<const T> backward() {
+            tensor::Tensor_View<const T> dX = this->loss_function->backward(this->arena);
+            if (this->segment_begin.empty()) {
+                for(int i = layer_objects.size() - 1; i >= 0; i --) {
+                    dX = layer_objects[i]->backward(dX, this->arena);
+                }
+                return dX;
             }
+            const size_t n_segments = this->segment_begin.size();
+            for (size_t s = n_segments; s -- > 0;) {
+                const size_t begin = this->segment_begin[s], end = this->_segment_end(s);
+                // the last segment still holds what its forward saved; the others run theirs again
+                if (s + 1 < n_segments) {
+                    this->segment_arena.reset();
+                    tensor::Tensor_View<const T> output = this->segment_input[s];
+                    for (size_t i = begin; i < end; i ++) {
+                        output = layer_objects[i]->forward(output, this->segment_arena);
+                    }
+                }
+                for (size_t i = end; i -- > begin;) {
+                    dX = layer_objects[i]->backward(dX, this->segment_arena);
+                }
+                this->segment_peak = std::max(this->segment_peak, this->segment_arena.bytes_in_use());
+                // out of the arena before the previous segment reuses it
+                if (s > 0) {
+                    tensor::Tensor<T>& grad = this->segment_grad[s % 2];
+                    grad.resize(dX.rows, dX.cols);
+                    grad.view().copy_from(dX);
+                    dX = grad.view();
+                }
+            }
+            return dX;
+        }
+
+        // backward() adds to dW and db, so every optimizer step starts from here
+        void zero_grad() {
+            if (this->parameters) {
+                this->parameters->zero_grad();
+                return;
+            }
+            for (auto* layer : this->learnable_layers()) {
+                layer->zero_grad();
+            }
+        }
+
+        // sizes the workspace for steps needing up to `bytes`, so they run without growing it;
+        // invalidates the views of the current step. With checkpointing on, `bytes` is shared between
+        // the main and the segment arena in the proportion the current step uses them or, before a
+        // step has run, in the proportion plan_checkpoints estimates for them.
+        void reserve_workspace(size_t bytes) {
+            if (this->segment_begin.empty()) {
+                this->arena.reset();
+                this->arena.reserve(bytes);
+                return;
+            }
+            size_t main = this->arena.bytes_in_use(), segment = this->segment_peak, grad = 0;
+            if (main == 0) {
+                // ALIGNMENT rows leave no padding in any buffer, so the estimate scales with the rows
+                this->_segment_bytes(this->_block_costs(tensor::ALIGNMENT), this->segment_begin, main, segment, grad);
+            } else {
+                grad = (this->segment_grad[0].size() + this->segment_grad[1].size()) * sizeof(T);
+            }
+            const double used = static_cast<double>(std::max<size_t>(1, main + segment + grad));
+            const size_t main_bytes = static_cast<size_t>(bytes * (main / used));
+            const size_t segment_bytes = static_cast<size_t>(bytes * (segment / used));
+            this->arena.reset();
+            this->arena.reserve(main_bytes);
+            this->segment_arena.reset();
+            this->segment_arena.reserve(segment_bytes);
+        }
+
+        // the most the workspace held at once during the current step, checkpointing buffers included
+        size_t step_workspace_bytes() const {
+            if (this->segment_begin.empty()) {
+                return this->arena.bytes_in_use();
+            }
+            return this->arena.bytes_in_use() + this->segment_peak + (this->segment_grad[0].size() + this->segment_grad[1].size()) * sizeof(T);
+        }
+
+        // Activation checkpointing: segment_begin lists the first block of every segment, starting
+        // with 0 (empty turns checkpointing off). forward keeps only the input of each segment, and
+        // backward recomputes a segment's activations right before running through it: one extra
+        // forward over every segment but the last, in exchange for holding one segment at a time
+        // instead of every activation of the step.
+        void set_checkpoints(const std::vector<size_t>& segment_begin) {
+            for (size_t s = 0; s < segment_begin.size(); s ++) {
+                if ((s == 0 && segment_begin[s] != 0) || (s > 0 && segment_begin[s] <= segment_begin[s - 1]) || segment_begin[s] >= this->layer_objects.size()) {
+                    throw std::invalid_argument("Segments must start at block 0 and at increasing block indices.");
+                }
+            }
+            this->segment_begin = segment_begin;
+            this->segment_input.clear();
+            this->segment_peak = 0;
+        }
+        const std::vector<size_t>& get_checkpoints() const {
+            return this->segment_begin;
+        }
+
+        // Segments for a step on batch_rows rows that keeps the workspace within memory_budget bytes,
+        // from an upper bound of what each block allocates: its output in forward, and in backward a
+        // gradient for its input and one for its output. Returns no segments when the whole step fits,
+        // and otherwise the fewest segments (the least recomputation) that do; throws when even a
+        // checkpoint at every block does not fit.
+        std::vector<size_t> plan_checkpoints(size_t memory_budget, size_t batch_rows) const {
+            const size_t L = this->layer_objects.size();
+            const Block_Costs c = this->_block_costs(batch_rows);
+            const std::vector<size_t>& cost = c.cost;
+            size_t total = c.loss;
+            for (size_t i = 0; i < L; i ++) {
+                total += cost[i];
+            }
+            if (total <= memory_budget) {
+                return {};
+            }
+
+            // greedy segments of at most `cap` bytes each; checkpoints and logits stay in the main arena,
+            // and besides the segment being run backward holds the gradients handed between segments
+            auto plan = [&](size_t cap, size_t& peak) {
+                std::vector<size_t> begin = {0};
+                size_t seg_cost = 0;
+                for (size_t i = 0; i < L; i ++) {
+                    if (seg_cost > 0 && seg_cost + cost[i] > cap) {
+                        begin.push_back(i);
+                        seg_cost = 0;
+                    }
+                    seg_cost += cost[i];
+                }
+                size_t main, segment, grad;
+                this->_segment_bytes(c, begin, main, segment, grad);
+                peak = main + segment + grad;
+                return begin;
+            };
+            std::vector<size_t> best;
+            size_t best_peak = 0;
+            // every contiguous run of blocks is a candidate segment size
+            for (size_t i = 0; i < L; i ++) {
+                size_t cap = 0;
+                for (size_t j = i; j < L; j ++) {
+                    cap += cost[j];
+                    size_t peak;
+                    std::vector<size_t> begin = plan(cap, peak);
+                    if (peak > memory_budget) {
+                        continue;
+                    }
+                    if (best.empty() || begin.size() < best.size() || (begin.size() == best.size() && peak < best_peak)) {
+                        best = begin;
+                        best_peak = peak;
+                    }
+                }
+            }
+            if (best.empty()) {
+                throw std::invalid_argument("The memory budget does not hold the step even with a checkpoint at every block.");
+            }
+            return best;
+        }
+
+        // plan_checkpoints, then set_checkpoints
+        void enable_checkpointing(size_t memory_budget, size_t batch_rows) {
+            this->set_checkpoints(this->plan_checkpoints(memory_budget, batch_rows));
+        }
+
+        // the blocks holding parameters, in forward order
+        std::vector<Block::Layer::Linear_Layer<T>*> learnable_layers() {
+            std::vector<Block::Layer::Linear_Layer<T>*> res;
+            for (const auto& layer : this->layer_objects) {
+                if (auto* linear = dynamic_cast<Block::Layer::Linear_Layer<T>*>(layer.get())) {
+                    res.push_back(linear);
+                }
+            }
+            return res;
+        }
+        std::vector<const Block::Layer::Linear_Layer<T>*> learnable_layers() const {
+            std::vector<const Block::Layer::Linear_Layer<T>*> res;
+            for (const auto& layer : this->layer_objects) {
+                if (auto* linear = dynamic_cast<const Block::Layer::Linear_Layer<T>*>(layer.get())) {
+                    res.push_back(linear);
+                }
+            }
+            return res;
+        }
+
+        // Moves every W, b, dW and db into one arena owned by the network (on the first call) and
+        // returns it, e.g for the fused optimizers. A copy of the network gets its own parameters again.
+        Optimizer::Parameter_Arena<T>& parameter_arena() {
+            if (!this->parameters) {
+                this->parameters = std::make_unique<Optimizer::Parameter_Arena<T>>(this->learnable_layers());
+            }
+            return *this->parameters;
+        }
+
+        // bfloat16 weight storage for every linear block, see Linear_Layer::store_weights_bf16;
+        // meant for a model that is done training
+        void store_weights_bf16() {
+            for (auto* layer : this->learnable_layers()) {
+                layer->store_weights_bf16();
+            }
+        }
+
+        // Calibration pass for quantize_int8: the range of the input of every linear block, in
+        // learnable_layers() order, over no-grad passes on batches of x
+        std::vector<quantization::Range> calibrate(tensor::Tensor_View<const T> x, size_t batch_size = 256) const {
+            if (batch_size == 0) {
+                throw std::invalid_argument("batch_size must be positive.");
+            }
+            std::vector<size_t> linear_index(this->layer_objects.size(), this->layer_objects.size());
+            size_t n_linear = 0;
+            for (size_t i = 0; i < this->layer_objects.size(); i ++) {
+                if (dynamic_cast<const Block::Layer::Linear_Layer<T>*>(this->layer_objects[i].get())) {
+                    linear_index[i] = n_linear;
+                    n_linear += 1;
+                }
+            }
+            std::vector<quantization::Range> ranges(n_linear);
+            Inference_Buffers<T> buffers;
+            for (size_t b = 0; b < x.rows; b += batch_size) {
+                this->_infer(x.slice_rows(b, std::min(batch_size, x.rows - b)), buffers, [&](size_t i, tensor::Tensor_View<const T> input) {
+                    if (linear_index[i] < n_linear) {
+                        ranges[linear_index[i]].merge(quantization::Range::compute<T>(input));
+                    }
+                });
+            }
+            return ranges;
+        }
+
+        // int8 weights for every linear block (see Linear_Layer::quantize_int8), each quantizing its
+        // input with the scale and zero point that cover what it saw on the calibration set;
+        // meant for a trained model that from now on only serves inference
+        void quantize_int8(tensor::Tensor_View<const T> calibration, size_t batch_size = 256) {
+            std::vector<quantization::Range> ranges = this->calibrate(calibration, batch_size);
+            std::vector<Block::Layer::Linear_Layer<T>*> layers = this->learnable_layers();
+            for (size_t i = 0; i < layers.size(); i ++) {
+                layers[i]->quantize_int8(quantization::Activation_Params::from_range(ranges[i]));
+            }
+        }
+
+        // the architecture as given to the constructor, e.g "linear-relu-linear"
+        std::string get_architecture() const {
+            std::string res;
+            for (size_t i = 0; i < this->layers_name.size(); i ++) {
+                res += (i > 0 ? "-" : "") + this->layers_name[i];
+            }
+            return res;
+        }
+        const std::valarray<int>& get_num_dims() const {
+            return this->num_dims;
+        }
+
+        const workspace::Arena& get_workspace() const {
+            return this->arena;
         }
 
     };
-}
\ No newline at end of file
+}
+
+#endif
@@ -1,117 +1,449 @@
+#ifndef NN_LAYERS_H
+#define NN_LAYERS_H
+
 #include <cmath>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <random>
-#include <valarray>
+#include <string>
 #include <vector>
+#include <memory>
 #include <cassert>
+#include <stdexcept>
 
+#include "tensor.hpp"
+#include "workspace.hpp"
+#include "thread_pool.hpp"
 #include "nn_utils.hpp"
+#include "activation_kernels.hpp"
+#include "quantization.hpp"
+#include "sparse.hpp"
 
 namespace Block {
 
+    // forward / backward take their output (and any scratch) from the step's workspace arena and
+    // return a view into it. Whatever a block saves for backward is a view as well: the input view it
+    // was given, or its own output, so nothing is copied. Both stay valid until the arena is reset,
+    // i.e for the rest of the training step.
+    //
+    // infer is the no-grad path: it writes the output into a buffer the caller provides, of shape
+    // [rows, output_cols(cols)], and saves nothing, so it is const and a model can serve several
+    // callers at once as long as each brings its own buffers.
     template <typename T>
     class Basic_Block {
     public:
-        virtual std::vector<std::valarray<T>> forward(const std::vector<std::valarray<T>>& x_batch) = 0;
-        virtual std::vector<std::valarray<T>> backward(const std::vector<std::valarray<T>>& dX) = 0;
+        virtual ~Basic_Block() = default;
+        virtual tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) = 0;
+        virtual tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) = 0;
+        virtual void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const = 0;
+        virtual size_t output_cols(size_t inp_cols) const = 0;
+        // independent copy with the same parameters, e.g for a data-parallel replica
+        virtual std::unique_ptr<Basic_Block<T>> clone() const = 0;
     };
 
     namespace Layer {
 
         template <typename T>
         class Linear_Layer: public Block::Basic_Block<T> {
-        private:
+        protected:
             size_t inp_dim;
             size_t out_dim;
-            std::vector<std::valarray<T>> W;
-            std::valarray<T> b;
-            std::vector<std::valarray<T>> dW;
-            std::valarray<T> db;
-            std::vector<std::valarray<T>> x_stored;
+            tensor::Tensor<T> W;
+            tensor::Tensor<T> b;
+            tensor::Tensor<T> dW;
+            tensor::Tensor<T> db;
+            // replaces W once store_weights_bf16() has been called
+            tensor::Tensor<tensor::bfloat16> W_bf16;
+            // replaces W (or W_bf16) once quantize_int8() has been called
+            quantization::Int8_Weights W_int8;
+            tensor::Tensor_View<const T> x_stored;
+
+            // out = x * W^T, finished by the epilogue, from whichever copy of W the layer holds
+            template <typename Epilogue>
+            void _affine(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out, const Epilogue& epilogue) const {
+                if (!this->W_int8.empty()) {
+                    this->W_int8.gemm<T>(x_batch, out, epilogue);
+                }
+                else if (this->W_bf16.empty()) {
+                    gemm::gemm_nt<T>(1, x_batch, this->W, 0, out, epilogue);
+                }
+                else {
+                    gemm::gemm_nt<T>(1, x_batch, this->W_bf16, 0, out, epilogue);
+                }
+            }
+
+            // gradient buffers are allocated on first use, so a model that only serves inference never holds them
+            void _ensure_grads() {
+                if (this->dW.empty()) {
+                    this->dW = ops_utils::init_matrix::generate_zeros_matrix<T>(this->out_dim, this->inp_dim);
+                    this->db = ops_utils::init_matrix::generate_zeros_matrix<T>(this->out_dim);
+                }
+            }
+
+            // gradients of x * W^T + b given dZ, the gradient w.r.t. that affine output. dW and db are
+            // accumulated (beta = 1), so several backward passes, e.g over the micro-batches of one
+            // large batch, add up until zero_grad()
+            tensor::Tensor_View<T> _backward_affine(tensor::Tensor_View<const T> dZ, workspace::Arena& arena) {
+                if (!this->W_int8.empty()) {
+                    throw std::logic_error("A layer with int8 weights only runs inference; train the float model and quantize it afterwards.");
+                }
+                this->_ensure_grads();
+                // dZ has shape [N, out_dim], x_stored has shape [N, inp_dim]; no operand is transposed in memory
+                gemm::gemm_tn<T>(1, dZ, this->x_stored, 1, this->dW);
+                ops_utils::reduced_sum<T>(dZ, this->db, 0, true);
+                tensor::Tensor_View<T> dX_new = arena.allocate<T>(dZ.rows, this->inp_dim);
+                if (this->W_bf16.empty()) {
+                    gemm::gemm<T>(1, dZ, this->W, 0, dX_new);
+                }
+                else {
+                    gemm::gemm<T>(1, dZ, this->W_bf16, 0, dX_new);
+                }
+                return dX_new;
+            }
+
         public:
-            Linear_Layer(size_t out_dim, size_t inp_dim) {
+            // initialize = false leaves W and b empty, for a checkpoint to fill in
+            Linear_Layer(size_t out_dim, size_t inp_dim, bool initialize = true) {
                 this->inp_dim = inp_dim;
                 this->out_dim = out_dim;
-                this->W = ops_utils::init_matrix::He_initialization<T>(out_dim, inp_dim);
-                this->b = ops_utils::init_matrix::generate_zeros_matrix<T>(out_dim);
-                this->dW = ops_utils::init_matrix::generate_zeros_matrix<T>(out_dim, inp_dim);
-                this->db = ops_utils::init_matrix::generate_zeros_matrix<T>(out_dim);
+                if (initialize) {
+                    this->W = ops_utils::init_matrix::He_initialization<T>(out_dim, inp_dim);
+                    this->b = ops_utils::init_matrix::generate_zeros_matrix<T>(out_dim);
+                }
             }
-            std::vector<std::valarray<T>> forward(const std::vector<std::valarray<T>>& x_batch) override {
-                std::vector<std::valarray<T>> result;
+            tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> result = arena.allocate<T>(x_batch.rows, this->out_dim);
+                this->infer(x_batch, result);
                 this->x_stored = x_batch;
-                for (int i = 0; i < x_batch.size(); i ++) {
-                    std::valarray<T> wx = ops_utils::matmul<T>(this->W, x_batch[i]);
-                    std::valarray<T> wxb = ops_utils::add<T>(wx, this->b);
-                    result.push_back(wxb);
-                }
                 return result;
             }
 
-            std::vector<std::valarray<T>> backward(const std::vector<std::valarray<T>>& dX) override {
-                std::vector<std::valarray<T>> result;
-                this->dW = ops_utils::matmul(ops_utils::transpose(this->x_stored), dX);
-                this->db = ops_utils::reduced_sum(dX, 0);
-                std::vector<std::valarray<T>> dX_new = ops_utils::transpose(ops_utils::matmul(this->W, ops_utils::transpose(dX)));
-                return dX_new;
+            void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const override {
+                // the whole batch at once: out = x_batch * W^T + b, with b added as each tile is stored
+                this->_affine(x_batch, out, gemm::Bias_Epilogue<T>{this->b.data()});
+            }
+
+            size_t output_cols(size_t) const override {
+                return this->out_dim;
+            }
+
+            std::unique_ptr<Block::Basic_Block<T>> clone() const override {
+                return std::make_unique<Linear_Layer<T>>(*this);
+            }
+
+            tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) override {
+                return this->_backward_affine(dX, arena);
+            }
+
+            // Re-points W, b, dW and db at memory owned by a Parameter_Arena, which has to outlive the
+            // layer's use of them. The current values are copied over; missing ones are left as they
+            // are in the arena (zero).
+            void bind_parameters(T* W_data, T* b_data, T* dW_data, T* db_data) {
+                assert(this->W_bf16.empty() && this->W_int8.empty() && "Only layers with float weights can be trained.");
+                tensor::Tensor<T> W_new = tensor::Tensor<T>::borrow(W_data, this->out_dim, this->inp_dim);
+                tensor::Tensor<T> b_new = tensor::Tensor<T>::borrow(b_data, 1, this->out_dim);
+                tensor::Tensor<T> dW_new = tensor::Tensor<T>::borrow(dW_data, this->out_dim, this->inp_dim);
+                tensor::Tensor<T> db_new = tensor::Tensor<T>::borrow(db_data, 1, this->out_dim);
+                if (!this->W.empty()) {
+                    W_new.copy_from(this->W);
+                    b_new.copy_from(this->b);
+                }
+                if (!this->dW.empty()) {
+                    dW_new.copy_from(this->dW);
+                    db_new.copy_from(this->db);
+                }
+                this->W = std::move(W_new);
+                this->b = std::move(b_new);
+                this->dW = std::move(dW_new);
+                this->db = std::move(db_new);
             }
 
             void zero_grad() {
-                this->dW = ops_utils::init_matrix::generate_zeros_matrix<T>(this->out_dim, this->inp_dim);
-                this->db = ops_utils::init_matrix::generate_zeros_matrix<T>(this->out_dim);
+                this->_ensure_grads();
+                this->dW.fill(static_cast<T>(0));
+                this->db.fill(static_cast<T>(0));
+            }
+
+            // Keeps W in bfloat16 from now on: half the bytes (a quarter for double) streamed by every
+            // forward, while the GEMMs still accumulate in T. The layer keeps running forward and
+            // propagating gradients to its input, but W itself is gone, so it can no longer be trained.
+            void store_weights_bf16() {
+                if (!this->W_bf16.empty()) {
+                    return;
+                }
+                this->W_bf16 = tensor::Tensor<tensor::bfloat16>(this->out_dim, this->inp_dim);
+                for (size_t i = 0; i < this->W.size(); i ++) {
+                    this->W_bf16[i] = tensor::bfloat16(static_cast<float>(this->W[i]));
+                }
+                this->W = tensor::Tensor<T>();
+            }
+            bool has_bf16_weights() const {
+                return !this->W_bf16.empty();
+            }
+            const tensor::Tensor<tensor::bfloat16>& get_W_bf16() const {
+                return W_bf16;
             }
 
-            std::vector<std::valarray<T>>& get_W() {
+            // Keeps W in int8 from now on, quantized per output channel: a quarter of the float32 bytes,
+            // and integer GEMMs with int32 accumulation. Inputs are quantized with `input`, normally
+            // picked by Neural_Network::quantize_int8 from a calibration pass. Inference only.
+            void quantize_int8(const quantization::Activation_Params& input) {
+                if (!this->W_int8.empty()) {
+                    return;
+                }
+                // bfloat16 weights are widened first, which is exact
+                tensor::Tensor<T> widened;
+                if (!this->W_bf16.empty()) {
+                    widened = tensor::Tensor<T>(this->out_dim, this->inp_dim);
+                    for (size_t i = 0; i < widened.size(); i ++) {
+                        widened[i] = static_cast<T>(static_cast<float>(this->W_bf16[i]));
+                    }
+                }
+                const tensor::Tensor<T>& source = this->W_bf16.empty() ? this->W : widened;
+                this->W_int8 = quantization::Int8_Weights(source, input);
+                this->W = tensor::Tensor<T>();
+                this->W_bf16 = tensor::Tensor<tensor::bfloat16>();
+            }
+            bool has_int8_weights() const {
+                return !this->W_int8.empty();
+            }
+            const quantization::Int8_Weights& get_W_int8() const {
+                return W_int8;
+            }
+
+            size_t get_inp_dim() const {
+                return inp_dim;
+            }
+            size_t get_out_dim() const {
+                return out_dim;
+            }
+
+            tensor::Tensor<T>& get_W() {
+                return W;
+            }
+            const tensor::Tensor<T>& get_W() const {
                 return W;
             }
-            void set_W(const std::vector<std::valarray<T>>& new_W) {
+            void set_W(const tensor::Tensor<T>& new_W) {
                 W = new_W;
             }
-            std::valarray<T>& get_b() {
+            tensor::Tensor<T>& get_b() {
+                return b;
+            }
+            const tensor::Tensor<T>& get_b() const {
                 return b;
             }
-            void set_b(const std::valarray<T>& new_b) {
+            void set_b(const tensor::Tensor<T>& new_b) {
                 b = new_b;
             }
-            std::vector<std::valarray<T>>& get_dW() {
+            tensor::Tensor<T>& get_dW() {
+                this->_ensure_grads();
                 return dW;
             }
-            std::valarray<T>& get_db() {
+            tensor::Tensor<T>& get_db() {
+                this->_ensure_grads();
                 return db;
             }
 
         };
 
 
+        // "linear" followed by "relu" / "sigmoid" / "tanh" in one block: the activation runs in the
+        // GEMM epilogue, so the pre-activation output is never written out or re-read, and backward
+        // only needs the layer input and the activated output
         template <typename T>
-        class Sigmoid: public Block::Basic_Block<T> {
+        class Linear_Activation_Layer: public Linear_Layer<T> {
         private:
-            std::vector<std::valarray<T>> x_stored;
+            act_kernels::Activation activation;
+            tensor::Tensor_View<const T> y_stored;
         public:
-            std::vector<std::valarray<T>> forward(const std::vector<std::valarray<T>>& x_batch) override {
-                std::pair<size_t, size_t> x_batch_shape = ops_utils::get_shape<T>(x_batch);
+            Linear_Activation_Layer(size_t out_dim, size_t inp_dim, act_kernels::Activation activation, bool initialize = true) : Linear_Layer<T>(out_dim, inp_dim, initialize) {
+                this->activation = activation;
+            }
+
+            tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> result = arena.allocate<T>(x_batch.rows, this->out_dim);
+                this->infer(x_batch, result);
                 this->x_stored = x_batch;
-                std::vector<std::valarray<T>> result(x_batch_shape.first, std::valarray<T>(x_batch_shape.second));
+                this->y_stored = result;
+                return result;
+            }
+
+            void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const override {
+                this->_affine(x_batch, out, gemm::Bias_Activation_Epilogue<T>{this->b.data(), this->activation});
+            }
+
+            std::unique_ptr<Block::Basic_Block<T>> clone() const override {
+                return std::make_unique<Linear_Activation_Layer<T>>(*this);
+            }
 
-                for (int i = 0; i < x_batch_shape.first; i ++) {
-                    for (int j = 0; j < x_batch_shape.second; j ++) {
-                        result[i][j] = act_func::forward::sigmoid_function<T>(x_batch[i][j]);
+            tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> dZ = arena.allocate<T>(dX.rows, dX.cols);
+                parallel::parallel_for(0, dX.rows, parallel::grain_for(dX.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::activation_backward<T>(this->activation, this->y_stored.row(i), dX.row(i), dZ.row(i), dX.cols);
                     }
+                });
+                return this->_backward_affine(dZ, arena);
+            }
+        };
+
+        // First layer for wide sparse inputs given as CSR batches: out = x * W^T + b without x ever
+        // being dense. W is kept transposed, Wt [inp_dim, out_dim], so each nonzero reads one
+        // contiguous row of Wt, and the weight gradient is row-sparse: only the features seen since
+        // zero_grad() have a row of dWt, packed in the order they were first seen, and only those rows
+        // are stepped (see Optimizer::Sparse_Gradient_Descent). It takes no dense input, so it is not a
+        // Basic_Block; Sparse_Input_Network puts it in front of a Neural_Network.
+        template <typename T>
+        class Sparse_Linear_Layer {
+        private:
+            size_t inp_dim;
+            size_t out_dim;
+            tensor::Tensor<T> Wt;
+            tensor::Tensor<T> b;
+            tensor::Tensor<T> db;
+            // features with a gradient row, in row order, and the row of every feature (NO_ROW if none)
+            std::vector<uint32_t> touched;
+            std::vector<uint32_t> grad_row;
+            // the first touched.size() rows are in use
+            tensor::Tensor<T> dWt_rows;
+            sparse::CSR_View<T> x_stored;
+
+            void _ensure_grads() {
+                if (this->grad_row.empty()) {
+                    this->grad_row.assign(this->inp_dim, NO_ROW);
+                    this->db = ops_utils::init_matrix::generate_zeros_matrix<T>(this->out_dim);
                 }
-                return result;
             }
 
-            std::vector<std::valarray<T>> backward(const std::vector<std::valarray<T>>& dX) override {
-                std::pair<size_t, size_t> shape_x = ops_utils::get_shape<T>(this->x_stored);
-                std::vector<std::valarray<T>> result(shape_x.first, std::valarray<T>(shape_x.second));
-                for (int i = 0; i < shape_x.first; i ++) {
-                    for (int j = 0; j < shape_x.second; j ++) {
-                        result[i][j] = act_func::backward::sigmoid_function<T>(this->x_stored[i][j]);
+        public:
+            static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+            Sparse_Linear_Layer(size_t out_dim, size_t inp_dim, bool initialize = true) {
+                if (inp_dim >= NO_ROW) {
+                    throw std::invalid_argument("Sparse_Linear_Layer takes fewer than 2^32 - 1 input features.");
+                }
+                this->inp_dim = inp_dim;
+                this->out_dim = out_dim;
+                if (initialize) {
+                    // the bound only depends on rows + cols, so this draws from the same range as W would
+                    this->Wt = ops_utils::init_matrix::He_initialization<T>(inp_dim, out_dim);
+                    this->b = ops_utils::init_matrix::generate_zeros_matrix<T>(out_dim);
+                }
+            }
+
+            // x is referenced, not copied, and has to stay alive until backward() has run
+            void forward(sparse::CSR_View<T> x_batch, tensor::Tensor_View<T> out) {
+                this->infer(x_batch, out);
+                this->x_stored = x_batch;
+            }
+
+            void infer(sparse::CSR_View<T> x_batch, tensor::Tensor_View<T> out) const {
+                assert(x_batch.cols == this->inp_dim && out.cols == this->out_dim && "Sparse_Linear_Layer shape mismatch.");
+                sparse::spmm<T>(x_batch, this->Wt, this->b.data(), out);
+            }
+
+            // adds the gradients for dZ, the gradient w.r.t. the output of the last forward
+            void backward(tensor::Tensor_View<const T> dZ) {
+                this->_ensure_grads();
+                // new features get their rows first, in a serial pass, so the accumulation only reads grad_row
+                const size_t used = this->touched.size();
+                const sparse::CSR_View<T>& x = this->x_stored;
+                for (uint64_t p = x.row_ptr[0]; p < x.row_ptr[x.rows]; p ++) {
+                    if (this->grad_row[x.col[p]] == NO_ROW) {
+                        this->grad_row[x.col[p]] = static_cast<uint32_t>(this->touched.size());
+                        this->touched.push_back(x.col[p]);
                     }
                 }
-                std::vector<std::valarray<T>> dX_new = ops_utils::multiply(result, dX);
+                if (this->touched.size() > this->dWt_rows.rows()) {
+                    tensor::Tensor<T> grown(std::max(this->touched.size(), 2 * this->dWt_rows.rows()), this->out_dim);
+                    std::copy(this->dWt_rows.data(), this->dWt_rows.data() + used * this->out_dim, grown.data());
+                    this->dWt_rows = std::move(grown);
+                }
+                std::fill(this->dWt_rows.data() + used * this->out_dim, this->dWt_rows.data() + this->touched.size() * this->out_dim, static_cast<T>(0));
+                sparse::spmm_tn_rows<T>(x, dZ, this->grad_row.data(), this->dWt_rows.slice_rows(0, this->touched.size()));
+                ops_utils::reduced_sum<T>(dZ, this->db, 0, true);
+            }
+
+            void zero_grad() {
+                this->_ensure_grads();
+                for (uint32_t k : this->touched) {
+                    this->grad_row[k] = NO_ROW;
+                }
+                this->touched.clear();
+                this->db.fill(static_cast<T>(0));
+            }
+
+            size_t get_inp_dim() const {
+                return this->inp_dim;
+            }
+            size_t get_out_dim() const {
+                return this->out_dim;
+            }
+            tensor::Tensor<T>& get_Wt() {
+                return this->Wt;
+            }
+            const tensor::Tensor<T>& get_Wt() const {
+                return this->Wt;
+            }
+            tensor::Tensor<T>& get_b() {
+                return this->b;
+            }
+            const tensor::Tensor<T>& get_b() const {
+                return this->b;
+            }
+            tensor::Tensor<T>& get_db() {
+                this->_ensure_grads();
+                return this->db;
+            }
+            // the features with a gradient, and their rows of dWt: row r belongs to touched_features()[r]
+            const std::vector<uint32_t>& touched_features() const {
+                return this->touched;
+            }
+            tensor::Tensor_View<const T> get_dWt_rows() const {
+                return this->dWt_rows.view().slice_rows(0, this->touched.size());
+            }
+        };
+
+
+        // the derivatives in act_func::backward are written in terms of the activation output,
+        // so the activation layers keep their output rather than their input
+        template <typename T>
+        class Sigmoid: public Block::Basic_Block<T> {
+        private:
+            tensor::Tensor_View<const T> y_stored;
+        public:
+            tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> result = arena.allocate<T>(x_batch.rows, x_batch.cols);
+                this->infer(x_batch, result);
+                this->y_stored = result;
+                return result;
+            }
+
+            void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const override {
+                parallel::parallel_for(0, x_batch.rows, parallel::grain_for(x_batch.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::sigmoid_forward<T>(x_batch.row(i), out.row(i), x_batch.cols);
+                    }
+                });
+            }
+
+            size_t output_cols(size_t inp_cols) const override {
+                return inp_cols;
+            }
+
+            std::unique_ptr<Block::Basic_Block<T>> clone() const override {
+                return std::make_unique<Sigmoid<T>>(*this);
+            }
+
+            tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> dX_new = arena.allocate<T>(dX.rows, dX.cols);
+                parallel::parallel_for(0, dX.rows, parallel::grain_for(dX.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::sigmoid_backward<T>(this->y_stored.row(i), dX.row(i), dX_new.row(i), dX.cols);
+                    }
+                });
                 return dX_new;
             }
 
@@ -121,30 +453,38 @@ namespace Block {
         template <typename T>
         class ReLU: public Block::Basic_Block<T> {
         private:
-            std::vector<std::valarray<T>> x_stored;
+            tensor::Tensor_View<const T> y_stored;
         public:
-            std::vector<std::valarray<T>> forward(const std::vector<std::valarray<T>>& x_batch) override {
-                this->x_stored = x_batch;
-                std::pair<size_t, size_t> x_batch_shape = ops_utils::get_shape(x_batch);
-                std::vector<std::valarray<T>> result(x_batch_shape.first, std::valarray<T>(x_batch_shape.second));
+            tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> result = arena.allocate<T>(x_batch.rows, x_batch.cols);
+                this->infer(x_batch, result);
+                this->y_stored = result;
+                return result;
+            }
 
-                for (int i = 0; i < x_batch_shape.first; i ++) {
-                    for (int j = 0; j < x_batch_shape.second; j ++) {
-                        result[i][j] = act_func::forward::relu_function<T>(x_batch[i][j]);
+            void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const override {
+                parallel::parallel_for(0, x_batch.rows, parallel::grain_for(x_batch.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::relu_forward<T>(x_batch.row(i), out.row(i), x_batch.cols);
                     }
-                }
-                return result;
+                });
             }
 
-            std::vector<std::valarray<T>> backward(const std::vector<std::valarray<T>>& dX) override {
-                std::pair<size_t, size_t> shape_x = ops_utils::get_shape<T>(this->x_stored);
-                std::vector<std::valarray<T>> result(shape_x.first, std::valarray<T>(shape_x.second));
-                for (int i = 0; i < shape_x.first; i ++) {
-                    for (int j = 0; j < shape_x.second; j ++) {
-                        result[i][j] = act_func::backward::relu_function<T>(this->x_stored[i][j]);
+            size_t output_cols(size_t inp_cols) const override {
+                return inp_cols;
+            }
+
+            std::unique_ptr<Block::Basic_Block<T>> clone() const override {
+                return std::make_unique<ReLU<T>>(*this);
+            }
+
+            tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> dX_new = arena.allocate<T>(dX.rows, dX.cols);
+                parallel::parallel_for(0, dX.rows, parallel::grain_for(dX.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::relu_backward<T>(this->y_stored.row(i), dX.row(i), dX_new.row(i), dX.cols);
                     }
-                }
-                std::vector<std::valarray<T>> dX_new = ops_utils::multiply(result, dX);
+                });
                 return dX_new;
             }
         };
@@ -153,30 +493,38 @@ namespace Block {
         template <typename T>
         class Tanh: public Block::Basic_Block<T> {
         private:
-            std::vector<std::valarray<T>> x_stored;
+            tensor::Tensor_View<const T> y_stored;
         public:
-            std::vector<std::valarray<T>> forward(const std::vector<std::valarray<T>>& x_batch) override {
-                this->x_stored = x_batch;
-                std::pair<size_t, size_t> x_batch_shape = ops_utils::get_shape(x_batch);
-                std::vector<std::valarray<T>> result(x_batch_shape.first, std::valarray<T>(x_batch_shape.second));
+            tensor::Tensor_View<T> forward(tensor::Tensor_View<const T> x_batch, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> result = arena.allocate<T>(x_batch.rows, x_batch.cols);
+                this->infer(x_batch, result);
+                this->y_stored = result;
+                return result;
+            }
 
-                for (int i = 0; i < x_batch_shape.first; i ++) {
-                    for (int j = 0; j < x_batch_shape.second; j ++) {
-                        result[i][j] = act_func::forward::tanh_function<T>(x_batch[i][j]);
+            void infer(tensor::Tensor_View<const T> x_batch, tensor::Tensor_View<T> out) const override {
+                parallel::parallel_for(0, x_batch.rows, parallel::grain_for(x_batch.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::tanh_forward<T>(x_batch.row(i), out.row(i), x_batch.cols);
                     }
-                }
-                return result;
+                });
+            }
+
+            size_t output_cols(size_t inp_cols) const override {
+                return inp_cols;
             }
 
-            std::vector<std::valarray<T>> backward(const std::vector<std::valarray<T>>& dX) override {
-                std::pair<size_t, size_t> shape_x = ops_utils::get_shape<T>(this->x_stored);
-                std::vector<std::valarray<T>> result(shape_x.first, std::valarray<T>(shape_x.second));
-                for (int i = 0; i < shape_x.first; i ++) {
-                    for (int j = 0; j < shape_x.second; j ++) {
-                        result[i][j] = act_func::backward::tanh_function<T>(this->x_stored[i][j]);
+            std::unique_ptr<Block::Basic_Block<T>> clone() const override {
+                return std::make_unique<Tanh<T>>(*this);
+            }
+
+            tensor::Tensor_View<T> backward(tensor::Tensor_View<const T> dX, workspace::Arena& arena) override {
+                tensor::Tensor_View<T> dX_new = arena.allocate<T>(dX.rows, dX.cols);
+                parallel::parallel_for(0, dX.rows, parallel::grain_for(dX.cols), [&](size_t i0, size_t i1) {
+                    for (size_t i = i0; i < i1; i ++) {
+                        act_kernels::tanh_backward<T>(this->y_stored.row(i), dX.row(i), dX_new.row(i), dX.cols);
                     }
-                }
-                std::vector<std::valarray<T>> dX_new = ops_utils::multiply(result, dX);
+                });
                 return dX_new;
             }
         };
@@ -188,17 +536,25 @@ namespace Block {
         template <typename T>
         class Binary_Cross_Entropy_Loss {
         public:
-            std::valarray<T> forward(const std::vector<std::valarray<T>>& pred, const std::vector<std::valarray<T>>& target) {
+            tensor::Tensor<T> forward(tensor::Tensor_View<const T> pred, tensor::Tensor_View<const T> target) {
 
             }
         };
 
+        // Softmax cross-entropy of logits [N, C] against either a distribution per row (target
+        // [N, C], e.g one-hot) or integer class labels (target [N, 1], the way Dataset and Data_Loader
+        // hold them; C must then be more than 1). forward computes the loss and the gradient together,
+        // one fused pass per row with the rows split across the pool, and backward hands out that
+        // gradient.
+        //
+        // With reduction "mean" the loss and its gradient are divided by `normalizer`, the number
+        // of rows of the batch by default. A batch run in pieces (shards, micro-batches) passes the
+        // rows of the whole batch, so the losses and gradients of the pieces add up to the batch's.
         template <typename T>
         class Cross_Entropy_Loss {
         private:
             std::string reduction;
-            std::vector<std::valarray<T>> logits;
-            std::vector<std::valarray<T>> target;
+            tensor::Tensor_View<T> grad;
         public:
             Cross_Entropy_Loss() {
                 this->reduction = "mean";
@@ -206,42 +562,40 @@ namespace Block {
             Cross_Entropy_Loss(const std::string& reduction) {
                 this->reduction = reduction;
             }
-            T forward(const std::vector<std::valarray<T>>& pred, const std::vector<std::valarray<T>>& target) {
-                this->logits = pred;
-                this->target = target;
-                std::pair<size_t, size_t> shape_pred = ops_utils::get_shape<T>(pred);
-                std::pair<size_t, size_t> shape_target = ops_utils::get_shape<T>(target);
-                assert((shape_pred.first == shape_target.first && shape_pred.second == shape_target.second) && "prediction and target must be in same size.");
-                T res = 0;
-                for (int i = 0; i < pred.size(); i ++){
-                    T abc = ops_utils::sum(loss_function::log_softmax_function<T>(pred) * target[i]);
-                    res += abc;
-                }
-                if (this->reduction == "mean") {
-                    return res / shape_pred.first;
+            T forward(tensor::Tensor_View<const T> pred, tensor::Tensor_View<const T> target, workspace::Arena& arena, size_t normalizer = 0) {
+                const bool labels = target.cols == 1 && pred.cols > 1;
+                assert((pred.rows == target.rows && (labels || pred.cols == target.cols)) && "target must be [N, C] or [N, 1] labels.");
+                if (labels) {
+                    for (size_t i = 0; i < target.rows; i ++) {
+                        if (!(target(i, 0) >= 0 && target(i, 0) < static_cast<T>(pred.cols))) {
+                            throw std::invalid_argument("Class label out of range.");
+                        }
+                    }
                 }
-                else {
-                    return res;
+                if (normalizer == 0) {
+                    normalizer = pred.rows;
                 }
+                const T scale = this->reduction == "mean" ? static_cast<T>(1) / static_cast<T>(normalizer) : static_cast<T>(1);
+                this->grad = arena.allocate<T>(pred.rows, pred.cols);
+                T res = parallel::parallel_reduce(size_t(0), pred.rows, parallel::grain_for(pred.cols), static_cast<T>(0), [&](size_t i0, size_t i1) {
+                    T partial = 0;
+                    for (size_t i = i0; i < i1; i ++){
+                        const T* t = labels ? nullptr : target.row(i);
+                        const size_t label = labels ? static_cast<size_t>(target(i, 0)) : 0;
+                        partial += loss_function::softmax_cross_entropy<T>(pred.row(i), t, label, this->grad.row(i), pred.cols, scale);
+                    }
+                    return partial;
+                }, [](T a, T b) { return a + b; });
+                return res * scale;
             }
 
-            std::vector<std::valarray<T>> backward() {
-
-                std::pair<size_t, size_t> shape_pred = ops_utils::get_shape<T>(this->logits);
-                std::pair<size_t, size_t> shape_target = ops_utils::get_shape<T>(this->target);
-                assert((shape_pred.first == shape_target.first && shape_pred.second == shape_target.second) && "prediction and target must be in same size.");
-
-                std::vector<std::valarray<T>> minus_pred = ops_utils::subtract<T>(1, this->logits);
-                std::vector<std::valarray<T>> minus_target = ops_utils::subtract<T>(1, this->target);
-
-                std::vector<std::valarray<T>> t_divide_o = ops_utils::divide<T>(this->target, this->logits);
-                std::vector<std::valarray<T>> minus_t_divide_o = ops_utils::divide<T>(minus_target, minus_pred);
-
-                std::vector<std::valarray<T>> res = ops_utils::subtract<T>(minus_t_divide_o, t_divide_o);
-
-                return res;
+            // gradient of the loss w.r.t. the logits, written by forward; lives in its workspace
+            tensor::Tensor_View<T> backward(workspace::Arena&) {
+                return this->grad;
             }
         };
     }
 
-}
\ No newline at end of file
+}
+
+#endif
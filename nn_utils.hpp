@@ -1,4 +1,8 @@
+#ifndef NN_UTILS_H
+#define NN_UTILS_H
+
 #include "ops_utils.hpp"
+#include "activation_kernels.hpp"
 #include <cmath>
 #include <algorithm>
 #include <chrono>
@@ -59,15 +63,59 @@ namespace act_func {
 }
 
 namespace loss_function {
-    // numerically stable version
+    // numerically stable version, writes log_softmax(x) of one row into out
     template <typename T>
-    std::valarray<T> log_softmax_function(const std::valarray<T> &x) {
-        std::pair<T, std::size_t> a = ops_utils::find_max_and_argmax(x);
+    void log_softmax_function(const T* x, T* out, size_t size) {
+        std::pair<T, std::size_t> a = ops_utils::find_max_and_argmax(x, size);
         T max_value_x = a.first;
-        std:size_t max_index_x = a.second;
-        std::valarray<T> y = x - max_value_x;
-        T logsumexp = std::log(ops_utils::sum<T>(std::exp(y)));
-        std::valarray<T> result = y - logsumexp;
-        return result;
+        T sum_exp = 0;
+        for (size_t j = 0; j < size; j ++) {
+            sum_exp += std::exp(x[j] - max_value_x);
+        }
+        T logsumexp = std::log(sum_exp);
+        for (size_t j = 0; j < size; j ++) {
+            out[j] = x[j] - max_value_x - logsumexp;
+        }
     }
-}
\ No newline at end of file
+
+    // Softmax cross-entropy of one row of logits, fused: returns -sum_j t_j * log_softmax(x)_j and
+    // writes scale times its gradient, scale * (softmax(x) * sum_j t_j - t), into grad, going over
+    // the row three times without any other buffer. The target t is a distribution over the size
+    // classes or, when t is null, the single class `label`; exp runs through the vectorized kernel.
+    template <typename T>
+    T softmax_cross_entropy(const T* x, const T* t, size_t label, T* grad, size_t size, T scale) {
+        T max_value_x = x[0];
+        for (size_t j = 1; j < size; j ++) {
+            max_value_x = x[j] > max_value_x ? x[j] : max_value_x;
+        }
+        for (size_t j = 0; j < size; j ++) {
+            grad[j] = x[j] - max_value_x;
+        }
+        act_kernels::exp<T>(grad, grad, size);
+        T sum_exp = 0;
+        for (size_t j = 0; j < size; j ++) {
+            sum_exp += grad[j];
+        }
+        const T logsumexp = std::log(sum_exp);
+        if (t == nullptr) {
+            const T p_scale = scale / sum_exp;
+            for (size_t j = 0; j < size; j ++) {
+                grad[j] *= p_scale;
+            }
+            grad[label] -= scale;
+            return logsumexp - (x[label] - max_value_x);
+        }
+        T sum_t = 0, dot = 0;
+        for (size_t j = 0; j < size; j ++) {
+            sum_t += t[j];
+            dot += t[j] * (x[j] - max_value_x);
+        }
+        const T p_scale = scale * sum_t / sum_exp;
+        for (size_t j = 0; j < size; j ++) {
+            grad[j] = grad[j] * p_scale - scale * t[j];
+        }
+        return sum_t * logsumexp - dot;
+    }
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef OPS_EXPR_H
+#define OPS_EXPR_H
+
+#include <cstddef>
+#include <cassert>
+#include <type_traits>
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+// Lazy elementwise arithmetic. An expression such as
+//     (1 - ref(t)) / (1 - ref(o)) - ref(t) / ref(o)
+// only builds a small tree of views and scalars; assign() then walks the destination once and
+// evaluates the whole tree per element in a single loop, without any temporary matrices.
+// Leaves are non-owning, so the tensors they refer to must outlive the expression.
+namespace ops_utils {
+
+    namespace expr {
+
+        template <typename E>
+        struct Expr {
+            const E& self() const {
+                return static_cast<const E&>(*this);
+            }
+        };
+
+        template <typename T>
+        struct Leaf: public Expr<Leaf<T>> {
+            using value_type = T;
+            const T* data;
+            size_t rows;
+            size_t cols;
+            size_t stride;
+
+            explicit Leaf(tensor::Tensor_View<const T> view) : data(view.data), rows(view.rows), cols(view.cols), stride(view.stride) {}
+
+            T at(size_t i, size_t j) const {
+                return this->data[i * this->stride + j];
+            }
+            bool matches(size_t rows, size_t cols) const {
+                return this->rows == rows && this->cols == cols;
+            }
+        };
+
+        // broadcast to every element
+        template <typename T>
+        struct Scalar: public Expr<Scalar<T>> {
+            using value_type = T;
+            T value;
+
+            explicit Scalar(T value) : value(value) {}
+
+            T at(size_t, size_t) const {
+                return this->value;
+            }
+            bool matches(size_t, size_t) const {
+                return true;
+            }
+        };
+
+        struct Add {
+            template <typename T>
+            static T apply(T a, T b) { return a + b; }
+        };
+
+        struct Subtract {
+            template <typename T>
+            static T apply(T a, T b) { return a - b; }
+        };
+
+        struct Multiply {
+            template <typename T>
+            static T apply(T a, T b) { return a * b; }
+        };
+
+        struct Divide {
+            template <typename T>
+            static T apply(T a, T b) { return a / b; }
+        };
+
+        struct Negate {
+            template <typename T>
+            static T apply(T a) { return -a; }
+        };
+
+        // children are held by value: every node is a handful of pointers and sizes
+        template <typename Op, typename L, typename R>
+        struct Binary: public Expr<Binary<Op, L, R>> {
+            using value_type = typename L::value_type;
+            L lhs;
+            R rhs;
+
+            Binary(const L& lhs, const R& rhs) : lhs(lhs), rhs(rhs) {}
+
+            value_type at(size_t i, size_t j) const {
+                return Op::apply(this->lhs.at(i, j), this->rhs.at(i, j));
+            }
+            bool matches(size_t rows, size_t cols) const {
+                return this->lhs.matches(rows, cols) && this->rhs.matches(rows, cols);
+            }
+        };
+
+        template <typename Op, typename E>
+        struct Unary: public Expr<Unary<Op, E>> {
+            using value_type = typename E::value_type;
+            E operand;
+
+            explicit Unary(const E& operand) : operand(operand) {}
+
+            value_type at(size_t i, size_t j) const {
+                return Op::apply(this->operand.at(i, j));
+            }
+            bool matches(size_t rows, size_t cols) const {
+                return this->operand.matches(rows, cols);
+            }
+        };
+
+        // turns a tensor or a view into an expression leaf
+        template <typename T>
+        Leaf<std::remove_const_t<T>> ref(tensor::Tensor_View<T> view) {
+            return Leaf<std::remove_const_t<T>>(view);
+        }
+
+        template <typename T>
+        Leaf<T> ref(const tensor::Tensor<T>& A) {
+            return Leaf<T>(A.view());
+        }
+
+#define OPS_EXPR_BINARY_OPERATOR(symbol, Op)                                                                              \
+        template <typename L, typename R>                                                                                 \
+        Binary<Op, L, R> operator symbol(const Expr<L>& lhs, const Expr<R>& rhs) {                                        \
+            return Binary<Op, L, R>(lhs.self(), rhs.self());                                                              \
+        }                                                                                                                 \
+        template <typename L>                                                                                             \
+        Binary<Op, L, Scalar<typename L::value_type>> operator symbol(const Expr<L>& lhs, typename L::value_type rhs) {   \
+            return Binary<Op, L, Scalar<typename L::value_type>>(lhs.self(), Scalar<typename L::value_type>(rhs));        \
+        }                                                                                                                 \
+        template <typename R>                                                                                             \
+        Binary<Op, Scalar<typename R::value_type>, R> operator symbol(typename R::value_type lhs, const Expr<R>& rhs) {   \
+            return Binary<Op, Scalar<typename R::value_type>, R>(Scalar<typename R::value_type>(lhs), rhs.self());        \
+        }
+
+        OPS_EXPR_BINARY_OPERATOR(+, Add)
+        OPS_EXPR_BINARY_OPERATOR(-, Subtract)
+        OPS_EXPR_BINARY_OPERATOR(*, Multiply)
+        OPS_EXPR_BINARY_OPERATOR(/, Divide)
+
+#undef OPS_EXPR_BINARY_OPERATOR
+
+        template <typename E>
+        Unary<Negate, E> operator-(const Expr<E>& operand) {
+            return Unary<Negate, E>(operand.self());
+        }
+
+        // dst = e, evaluated element by element in one pass over dst, rows split across the pool
+        template <typename T, typename E>
+        void assign(tensor::Tensor_View<T> dst, const Expr<E>& e) {
+            const E& ex = e.self();
+            assert(ex.matches(dst.rows, dst.cols) && "Expression and destination must be in same size.");
+            parallel::parallel_for(0, dst.rows, parallel::grain_for(dst.cols), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    T* d = dst.row(i);
+                    for (size_t j = 0; j < dst.cols; j ++) {
+                        d[j] = ex.at(i, j);
+                    }
+                }
+            });
+        }
+
+        template <typename T, typename E>
+        void assign(tensor::Tensor<T>& dst, const Expr<E>& e) {
+            expr::assign<T>(dst.view(), e);
+        }
+
+        // allocates the result once and evaluates into it
+        template <typename E>
+        tensor::Tensor<typename E::value_type> evaluate(const Expr<E>& e, size_t rows, size_t cols) {
+            tensor::Tensor<typename E::value_type> result(rows, cols);
+            expr::assign<typename E::value_type>(result.view(), e);
+            return result;
+        }
+    }
+}
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef OPS_UTILS_H
+#define OPS_UTILS_H
+
 #include <cmath>
 #include <algorithm>
 #include <chrono>
@@ -6,6 +9,11 @@
 #include <valarray> // different purpose use to vector. While vector is dynamically resizable and versatile, valarray is more numerically efficient
 #include <vector>
 #include <cassert>
+#include <stdexcept>
+
+#include "tensor.hpp"
+#include "ops_expr.hpp"
+#include "gemm.hpp"
 
 // for testing
 // #include <torch/torch.h>
@@ -15,28 +23,28 @@ namespace ops_utils {
     namespace init_matrix {
 
         template <typename T>
-        std::vector<std::valarray<T>> generate_uniform_matrix(size_t rows, size_t cols, T min_value = -1.0, T max_value = 1.0, unsigned int seed = 28) {
+        tensor::Tensor<T> generate_uniform_matrix(size_t rows, size_t cols, T min_value = -1.0, T max_value = 1.0, unsigned int seed = 28) {
             std::mt19937 gen(seed);
             std::uniform_real_distribution<> distrib(min_value, max_value);
-            std::vector<std::valarray<T>> matrix(rows, std::valarray<T>(cols));
+            tensor::Tensor<T> matrix(rows, cols);
             for (size_t i = 0; i < rows; ++i) {
                 for (size_t j = 0; j < cols; ++j) {
-                    matrix[i][j] = distrib(gen);
+                    matrix(i, j) = distrib(gen);
                 }
             }
             return matrix;
         }
 
         template <typename T>
-        std::vector<std::valarray<T>> He_initialization(size_t rows, size_t cols, unsigned int seed = 28) {
+        tensor::Tensor<T> He_initialization(size_t rows, size_t cols, unsigned int seed = 28) {
             std::mt19937 gen(seed);
             double max_value = std::sqrt(6.0) / std::sqrt(rows + cols);
             std::uniform_real_distribution<T> distrib(-max_value, max_value);
-            std::vector<std::valarray<T>> matrix(rows, std::valarray<T>(cols));
+            tensor::Tensor<T> matrix(rows, cols);
             
             for (size_t i = 0; i < rows; ++i) {
                 for (size_t j = 0; j < cols; ++j) {
-                    matrix[i][j] = distrib(gen);
+                    matrix(i, j) = distrib(gen);
                 }
             }
 
@@ -44,36 +52,31 @@ namespace ops_utils {
         }
 
         template <typename T>
-        std::vector<std::valarray<T>> generate_zeros_matrix(size_t rows, size_t cols) {
-            std::valarray<T> zero_valarray(static_cast<T>(0), cols);
-            std::vector<std::valarray<T>> matrix(rows, zero_valarray);
-            return matrix;
+        tensor::Tensor<T> generate_zeros_matrix(size_t rows, size_t cols) {
+            return tensor::Tensor<T>(rows, cols, static_cast<T>(0));
         }
 
         template <typename T>
-        std::valarray<T> generate_zeros_matrix(size_t cols) {
-            std::valarray<T> zero_valarray(static_cast<T>(0), cols);
-            return zero_valarray;
+        tensor::Tensor<T> generate_zeros_matrix(size_t cols) {
+            return tensor::Tensor<T>(1, cols, static_cast<T>(0));
         }
 
         template <typename T>
-        std::vector<std::valarray<T>> generate_ones_matrix(size_t rows, size_t cols) {
-            std::valarray<T> one_valarray(static_cast<T>(1), cols);
-            std::vector<std::valarray<T>> matrix(rows, one_valarray);
-            return matrix;
+        tensor::Tensor<T> generate_ones_matrix(size_t rows, size_t cols) {
+            return tensor::Tensor<T>(rows, cols, static_cast<T>(1));
         }
 
         template <typename T>
-        std::valarray<T> generate_ones_matrix(size_t cols) {
-            std::valarray<T> one_valarray(static_cast<T>(1), cols);
-            return one_valarray;
+        tensor::Tensor<T> generate_ones_matrix(size_t cols) {
+            return tensor::Tensor<T>(1, cols, static_cast<T>(1));
         }
     }
 
     //////////////////////////////////////////////////////////////////////////////////////////////////////////////
     // Extra operations for valarray
-    std::valarray<double> insert_element(const std::valarray<double>& array, double value) {
-        std::valarray<double> result(array.size() + 1);
+    template <typename T>
+    std::valarray<T> insert_element(const std::valarray<T>& array, T value) {
+        std::valarray<T> result(array.size() + 1);
         for (size_t i = 0; i < array.size(); ++i) {
             result[i] = array[i];
         }
@@ -81,16 +84,18 @@ namespace ops_utils {
         return result;
     }
 
-    std::valarray<double> pop_back(const std::valarray<double>& array) {
-        std::valarray<double> result(array.size() - 1);
+    template <typename T>
+    std::valarray<T> pop_back(const std::valarray<T>& array) {
+        std::valarray<T> result(array.size() - 1);
         for (size_t i = 0; i < array.size() - 1; ++i) {
             result[i] = array[i];
         }
         return result;
     }
 
-    std::valarray<double> pop_front(const std::valarray<double>& array) {
-        std::valarray<double> result(array.size() - 1);
+    template <typename T>
+    std::valarray<T> pop_front(const std::valarray<T>& array) {
+        std::valarray<T> result(array.size() - 1);
         for (size_t i = 1; i < array.size(); ++i) {
             result[i - 1] = array[i];
         }
@@ -99,10 +104,10 @@ namespace ops_utils {
     //////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     template <typename T>
-    void print_2D_matrix(const std::vector<std::valarray<T>>& A) {
-        for(size_t i = 0; i < A.size(); ++i) {
-            for(size_t j = 0; j < (*A.begin()).size(); ++j) {
-                std::cout << A[i][j] << " ";
+    void print_2D_matrix(tensor::Tensor_View<const T> A) {
+        for(size_t i = 0; i < A.rows; ++i) {
+            for(size_t j = 0; j < A.cols; ++j) {
+                std::cout << A(i, j) << " ";
             }
             std::cout << std::endl;
         }
@@ -115,26 +120,11 @@ namespace ops_utils {
         }
         std::cout << std::endl;
     }
-    // function for check if it is valid 2D matrix or not
-    template <typename T>
-    bool is_2D_matrix(const std::vector<std::valarray<T>>& A) {
-        if (A.empty()) {
-            return false;
-        }
-        size_t cols = A[0].size();
-        for (const auto& row : A) {
-            if (row.size() != cols) {
-                return false;
-            }
-        }
-        return true;
-    }
 
-    // function to get the shape of 2D vector
+    // function to get the shape of 2D matrix
     template <typename T>
-    std::pair<size_t, size_t> get_shape(const std::vector<std::valarray<T>>& A) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        return std::make_pair(A.size(), (*A.begin()).size());
+    std::pair<size_t, size_t> get_shape(tensor::Tensor_View<const T> A) {
+        return std::make_pair(A.rows, A.cols);
     }
 
     // function to get the shape of 1D vector
@@ -143,259 +133,145 @@ namespace ops_utils {
         return A.size();
     }
 
+    // the eager elementwise helpers are one-node expressions; chain expr:: operators instead when
+    // several of them would be combined, so the whole chain runs in a single pass
     template <typename T>
-    std::vector<std::valarray<T>> multiply(const std::vector<std::valarray<T>>& A, const T &val) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::vector<std::valarray<T>> A_copied = A;
-        for (auto &v : A_copied) { 
-            v = v * val;
-        }
-        return A_copied;
+    tensor::Tensor<T> multiply(tensor::Tensor_View<const T> A, const T &val) {
+        return expr::evaluate(expr::ref(A) * val, A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> multiply(const std::vector<std::valarray<T>>& A, const std::vector<std::valarray<T>>& B) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        assert(is_2D_matrix(B) && "Input is not a valid 2D matrix.");
-
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        std::pair<size_t, size_t> shape_b = get_shape(B);
-
-        assert((shape_a.first == shape_b.first && shape_a.second == shape_b.second) && "Two matrices must be same size.");
-        std::vector<std::valarray<T>> result = A;
-        for (int i = 0; i < shape_a.first; i ++) {
-            for (int j = 0; j < shape_a.second; j ++) {
-                result[i][j] = A[i][j] * B[i][j];
-            }
-        }
-        return result;
+    tensor::Tensor<T> multiply(tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B) {
+        assert((A.rows == B.rows && A.cols == B.cols) && "Two matrices must be same size.");
+        return expr::evaluate(expr::ref(A) * expr::ref(B), A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> divide(const std::vector<std::valarray<T>>& A, const T &val) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::vector<std::valarray<T>> result = A;
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        for (auto &v : result) { 
-            v = v / val;
-        }
-        return result;
-    }
-
-    template <typename T>
-    std::vector<std::valarray<double>> divide(const std::vector<std::valarray<T>>& A, const std::vector<std::valarray<T>>& B) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        assert(is_2D_matrix(B) && "Input is not a valid 2D matrix.");
-
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        std::pair<size_t, size_t> shape_b = get_shape(B);
-
-        assert((shape_a.first == shape_b.first && shape_a.second == shape_b.second) && "Two matrices must be same size.");
-        std::vector<std::valarray<double>> result = A;
-        for (int i = 0; i < shape_a.first; i ++) {
-            for (int j = 0; j < shape_a.second; j ++) {
-                result[i][j] = A[i][j] / B[i][j];
-            }
-        }
-        return result;
-    }
-
-    template <typename T>
-    std::vector<std::valarray<T>> add(const std::vector<std::valarray<T>>& A, const T &val) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::vector<std::valarray<T>> A_copied = A;
-        for (auto &v: A_copied) { 
-            v = v + val;
-        }
-        return A_copied;
-    }
-
-    template <typename T>
-    std::vector<std::valarray<T>> add(const std::vector<std::valarray<T>>& A, const std::vector<std::valarray<T>>& B) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        assert(is_2D_matrix(B) && "Input is not a valid 2D matrix.");
-
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        std::pair<size_t, size_t> shape_b = get_shape(B);
-
-        assert((shape_a.first == shape_b.first && shape_a.second == shape_b.second) && "Two matrices must be same size.");
-        std::vector<std::valarray<T>> result = A;
-        for (int i = 0; i < shape_a.first; i ++) {
-            for (int j = 0; j < shape_a.second; j ++) {
-                result[i][j] = A[i][j] + B[i][j];
-            }
-        }
-        return result;
+    tensor::Tensor<T> divide(tensor::Tensor_View<const T> A, const T &val) {
+        return expr::evaluate(expr::ref(A) / val, A.rows, A.cols);
     }
 
     template <typename T>
-    std::valarray<T> add(const std::valarray<T>& a, const std::valarray<T>& b) {
-        size_t dim_a = ops_utils::get_shape(a);
-        size_t dim_b = ops_utils::get_shape(b);
-        assert(dim_b == dim_a && "a and b must be in same dimension.");
-        std::valarray<double> result(0.0, dim_a);
-        for (int i = 0; i < dim_a; i ++) {
-            result[i] = a[i] + b[i];
-        }
-        return result;
+    tensor::Tensor<T> divide(tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B) {
+        assert((A.rows == B.rows && A.cols == B.cols) && "Two matrices must be same size.");
+        return expr::evaluate(expr::ref(A) / expr::ref(B), A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> subtract(const std::vector<std::valarray<T>>& A, const T &val) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::vector<std::valarray<T>> A_copied = A;
-        for (auto &v : A_copied) { 
-            v = v - val;
-        }
-        return A_copied;
+    tensor::Tensor<T> add(tensor::Tensor_View<const T> A, const T &val) {
+        return expr::evaluate(expr::ref(A) + val, A.rows, A.cols);
     }
 
     template <typename T>
-    std::valarray<T> subtract(const std::valarray<T>& A, const T &val) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::valarray<T> A_copied = A;
-        for (auto &v : A_copied) { 
-            v = v - val;
-        }
-        return A_copied;
+    tensor::Tensor<T> add(tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B) {
+        assert((A.rows == B.rows && A.cols == B.cols) && "Two matrices must be same size.");
+        return expr::evaluate(expr::ref(A) + expr::ref(B), A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> subtract(const T &val, const std::vector<std::valarray<T>>& A) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        std::vector<std::valarray<T>> A_copied = A;
-        for (auto &v : A_copied) { 
-            v = val - v;
-        }
-        return A_copied;
+    tensor::Tensor<T> subtract(tensor::Tensor_View<const T> A, const T &val) {
+        return expr::evaluate(expr::ref(A) - val, A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> subtract(const std::vector<std::valarray<T>>& A, const std::vector<std::valarray<T>>& B) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        assert(is_2D_matrix(B) && "Input is not a valid 2D matrix.");
-
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        std::pair<size_t, size_t> shape_b = get_shape(B);
-
-        assert((shape_a.first == shape_b.first && shape_a.second == shape_b.second) && "Two matrices must be same size.");
-        std::vector<std::valarray<T>> result = A;
-        for (int i = 0; i < shape_a.first; i ++) {
-            for (int j = 0; j < shape_a.second; j ++) {
-                result[i][j] = A[i][j] - B[i][j];
-            }
-        }
-        return result;
+    tensor::Tensor<T> subtract(const T &val, tensor::Tensor_View<const T> A) {
+        return expr::evaluate(val - expr::ref(A), A.rows, A.cols);
     }
 
     template <typename T>
-    std::valarray<T> subtract(const std::valarray<T>& a, const std::valarray<T>& b) {
-
-        size_t dim_a = ops_utils::get_shape(a);
-
-        size_t dim_b = ops_utils::get_shape(b);
-        assert(dim_b == dim_a && "a and b must be in same dimension.");
-
-        std::valarray<double> result(0.0, dim_a);
-        for (int i = 0; i < dim_a; i ++) {
-            result[i] = a[i] - b[i];
-        }
-        return result;
+    tensor::Tensor<T> subtract(tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B) {
+        assert((A.rows == B.rows && A.cols == B.cols) && "Two matrices must be same size.");
+        return expr::evaluate(expr::ref(A) - expr::ref(B), A.rows, A.cols);
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> matmul(const std::vector<std::valarray<T>>& A, const std::vector<std::valarray<T>>& B) {
-        assert(is_2D_matrix(A) && "Input is not a valid 2D matrix.");
-        assert(is_2D_matrix(B) && "Input is not a valid 2D matrix.");
-
-        std::pair<size_t, size_t> shape_a = get_shape(A);
-        std::pair<size_t, size_t> shape_b = get_shape(B);
-
-        assert((shape_a.second == shape_b.first) && "Second axis of first matrix must be equal to first axis of second matrix.");
-
-        std::vector<std::valarray<T>> result = init_matrix::generate_zeros_matrix<T>(shape_a.first, shape_b.second);
-
-        for (int i = 0; i < shape_a.first; i ++) {
-            for (int j = 0; j < shape_b.second; j ++) {
-                for (int k = 0; k < shape_a.second; k ++) {
-                    result[i][j] += A[i][j] * B[k][j];
-                }
-            }
-        }
+    tensor::Tensor<T> matmul(tensor::Tensor_View<const T> A, tensor::Tensor_View<const T> B) {
+        assert((A.cols == B.rows) && "Second axis of first matrix must be equal to first axis of second matrix.");
+        tensor::Tensor<T> result(A.rows, B.cols);
+        gemm::gemm<T>(1, A, B, 0, result);
         return result;
     }
 
     template<typename T>
-    T dot_product(const std::valarray<T>& a, const std::valarray<T>& b) {
-        size_t size_a = get_shape(a);
-        size_t size_b = get_shape(b);
-        assert(size_a == size_b && "a and b must be in same size.");
+    T dot_product(const T* a, const T* b, size_t size) {
         T result = 0.0;
-        for (int i = 0; i < size_a; i ++) {
+        for (size_t i = 0; i < size; i ++) {
             result += (a[i] * b[i]);
         }
         return result;
     }
 
+    // out[i] = dot(W[i], x); x and out are single rows, W has shape [D2, D1]
     template <typename T>
-    std::valarray<T> matmul(const std::vector<std::valarray<T>>& W, const std::valarray<T>& x) {
-        // x must have shape [D1] and W must have shape [D2, D1], matmul(W, x) must results in [D2]
-        std::pair<size_t, size_t> shape_W = ops_utils::get_shape(W);
-        size_t dim_x = ops_utils::get_shape(x);
-        assert(shape_W.second == dim_x && "Cannot multiply W and x.");
-        std::valarray<T> result(shape_W.first);
-        for (int i = 0; i < shape_W.first; i ++) {
-            result[i] = ops_utils::dot_product<T>(W[i], x);
+    void matvec(tensor::Tensor_View<const T> W, const T* x, T* out) {
+        for (size_t i = 0; i < W.rows; i ++) {
+            out[i] = ops_utils::dot_product<T>(W.row(i), x, W.cols);
         }
-        return result;
     }
 
     template <typename T>
-    std::vector<std::valarray<T>> transpose(const std::vector<std::valarray<T>>& W) {
-        std::pair<size_t, size_t> shape_W = ops_utils::get_shape(W);
-        std::vector<std::valarray<T>> result(shape_W.second, std::valarray<T>(shape_W.first));
-        for (int i = 0; i < shape_W.first; i ++) {
-            for (int j = 0; j < shape_W.second; j ++) {
-                result[j][i] = W[i][j];
+    tensor::Tensor<T> transpose(tensor::Tensor_View<const T> W) {
+        tensor::Tensor<T> result(W.cols, W.rows);
+        for (size_t i = 0; i < W.rows; i ++) {
+            for (size_t j = 0; j < W.cols; j ++) {
+                result(j, i) = W(i, j);
             }
         }
         return result;
     }
 
+    // dim = 0 sums over rows into [1, cols], dim = 1 sums over columns into [1, rows]
+    // dim 0 splits the columns across the pool and dim 1 the rows, so each output element is
+    // summed by a single thread in row order, whatever the thread count.
+    // accumulate = true adds the sums to what result already holds, e.g a gradient being accumulated
     template <typename T>
-    std::valarray<T> reduced_sum(const std::vector<std::valarray<T>>& A, int dim = 0) {
-        std::pair<size_t, size_t> shape_A = ops_utils::get_shape<T>(A);
-        std::valarray<T> result;
+    void reduced_sum(tensor::Tensor_View<const T> A, tensor::Tensor_View<T> result, int dim = 0, bool accumulate = false) {
+        assert(result.rows == 1 && result.cols == (dim == 0 ? A.cols : A.rows) && "Result has the wrong shape.");
+        T* r = result.data;
         if (dim == 0) {
-            result = ops_utils::init_matrix::generate_zeros_matrix<T>(shape_A.second);
+            parallel::parallel_for(0, A.cols, std::max<size_t>(16, parallel::grain_for(A.rows)), [&](size_t j0, size_t j1) {
+                if (!accumulate) {
+                    std::fill(r + j0, r + j1, static_cast<T>(0));
+                }
+                for (size_t i = 0; i < A.rows; i ++) {
+                    const T* a = A.row(i);
+                    for (size_t j = j0; j < j1; j ++) {
+                        r[j] += a[j];
+                    }
+                }
+            });
         }
         else {
-            result = ops_utils::init_matrix::generate_zeros_matrix<T>(shape_A.first);
-        }
-
-        for (int i = 0; i < shape_A.first; i ++) {
-            for (int j = 0; j < shape_A.second; j ++) {
-                if (dim == 0) {
-                    result[j] += A[i][j];
+            parallel::parallel_for(0, A.rows, parallel::grain_for(A.cols), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    const T* a = A.row(i);
+                    T acc = 0;
+                    for (size_t j = 0; j < A.cols; j ++) {
+                        acc += a[j];
+                    }
+                    r[i] = accumulate ? r[i] + acc : acc;
                 }
-                else {
-                    result[i] += A[i][j];
-                }
-            }
+            });
         }
+    }
+
+    template <typename T>
+    tensor::Tensor<T> reduced_sum(tensor::Tensor_View<const T> A, int dim = 0) {
+        tensor::Tensor<T> result(1, dim == 0 ? A.cols : A.rows);
+        ops_utils::reduced_sum<T>(A, result, dim);
         return result;
     }
 
     template <typename T>
-    std::pair<T, std::size_t> find_max_and_argmax(const std::valarray<T>& x) {
-        if (x.size() == 0) {
-            throw std::invalid_argument("Input valarray must not be empty.");
+    std::pair<T, std::size_t> find_max_and_argmax(const T* x, size_t size) {
+        if (size == 0) {
+            throw std::invalid_argument("Input row must not be empty.");
         }
 
         T max_value = x[0];
         std::size_t max_index = 0;
 
-        for (std::size_t i = 1; i < x.size(); ++i) {
+        for (std::size_t i = 1; i < size; ++i) {
             if (x[i] > max_value) {
                 max_value = x[i];
                 max_index = i;
@@ -406,12 +282,13 @@ namespace ops_utils {
     }
 
     template<typename T>
-    T sum(const std::valarray<T>& a) {
-        size_t size_a = get_shape(a);
+    T sum(const T* a, size_t size) {
         T result = 0.0;
-        for (int i = 0; i < size_a; i ++) {
+        for (size_t i = 0; i < size; i ++) {
             result += a[i];
         }
         return result;
     }
-}
\ No newline at end of file
+}
+
+#endif
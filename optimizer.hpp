@@ -1,4 +1,6 @@
-#include <valarray>
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
 #include <vector>
 #include <string>
 #include <iostream>
@@ -8,55 +10,345 @@
 #include <stdexcept>
 #include <cassert>
 #include <sstream>
+#include <cmath>
+
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "nn_layers.hpp"
+#include "thread_pool.hpp"
 
 
 namespace Optimizer {
 
+    // Every learnable tensor of a model in one contiguous buffer, and their gradients in a second one
+    // with the same layout: [W_0, b_0, W_1, b_1, ...], each tensor starting on a 64-byte boundary
+    // (the padding stays zero). The layers are re-pointed at the arena (Linear_Layer::bind_parameters),
+    // so forward / backward read and write it in place and an optimizer updates the whole model in one
+    // pass over flat memory. The arena must outlive the layers' use of it.
+    template <typename T>
+    class Parameter_Arena {
+    private:
+        tensor::Tensor<T> params;
+        tensor::Tensor<T> grads;
+
+    public:
+        explicit Parameter_Arena(const std::vector<Block::Layer::Linear_Layer<T>*>& layers) {
+            constexpr size_t ALIGN = tensor::ALIGNMENT / sizeof(T);
+            auto align_up = [](size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; };
+            std::vector<size_t> offsets;
+            size_t n = 0;
+            for (const auto* layer : layers) {
+                offsets.push_back(n);
+                n = align_up(n + layer->get_out_dim() * layer->get_inp_dim());
+                offsets.push_back(n);
+                n = align_up(n + layer->get_out_dim());
+            }
+            this->params = tensor::Tensor<T>(1, n, static_cast<T>(0));
+            this->grads = tensor::Tensor<T>(1, n, static_cast<T>(0));
+            for (size_t l = 0; l < layers.size(); l ++) {
+                layers[l]->bind_parameters(this->params.data() + offsets[2 * l], this->params.data() + offsets[2 * l + 1],
+                                           this->grads.data() + offsets[2 * l], this->grads.data() + offsets[2 * l + 1]);
+            }
+        }
+
+        // the layers point into the buffers
+        Parameter_Arena(const Parameter_Arena&) = delete;
+        Parameter_Arena& operator=(const Parameter_Arena&) = delete;
+
+        // number of elements in each buffer, padding included
+        size_t size() const {
+            return this->params.size();
+        }
+        T* parameters() {
+            return this->params.data();
+        }
+        const T* parameters() const {
+            return this->params.data();
+        }
+        T* gradients() {
+            return this->grads.data();
+        }
+        const T* gradients() const {
+            return this->grads.data();
+        }
+
+        void zero_grad() {
+            T* g = this->grads.data();
+            parallel::parallel_for(0, this->size(), parallel::grain_for(1), [&](size_t i0, size_t i1) {
+                std::fill(g + i0, g + i1, static_cast<T>(0));
+            });
+        }
+    };
+
     template <typename T>
     class Basic_Optimizer {
     public:
+        virtual ~Basic_Optimizer() = default;
         virtual void zero_grad() = 0;
         virtual void step() = 0;
     };
 
+    // The update rules are a single loop over flat memory each: chunks go to the pool, and a chunk
+    // reads every operand once and writes the results back in place, so a step costs one streaming
+    // pass. Being memory bound, they need nothing wider than the baseline ISA.
+    namespace detail {
+
+        template <typename T>
+        void sgd_update(T* p, const T* g, size_t n, T lr) {
+            parallel::parallel_for(0, n, parallel::grain_for(1), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    p[i] -= lr * g[i];
+                }
+            });
+        }
+
+        // v = momentum * v + (g + weight_decay * p); p -= lr * v
+        template <typename T>
+        void momentum_update(T* p, const T* g, T* v, size_t n, T lr, T momentum, T weight_decay) {
+            parallel::parallel_for(0, n, parallel::grain_for(1), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    T v_i = momentum * v[i] + (g[i] + weight_decay * p[i]);
+                    v[i] = v_i;
+                    p[i] -= lr * v_i;
+                }
+            });
+        }
+
+        // Adam with the bias corrections folded into step_size and inv_sqrt_bc2; l2 adds weight
+        // decay to the gradient (Adam), decay scales p directly (AdamW)
+        template <typename T>
+        struct Adam_Coefficients {
+            T beta1;
+            T beta2;
+            T eps;
+            T step_size;
+            T inv_sqrt_bc2;
+            T l2;
+            T decay;
+        };
+
+        template <typename T>
+        void adam_range(T* p, const T* g, T* m, T* v, size_t i0, size_t i1, const Adam_Coefficients<T>& c) {
+            for (size_t i = i0; i < i1; i ++) {
+                T g_i = g[i] + c.l2 * p[i];
+                T m_i = c.beta1 * m[i] + (1 - c.beta1) * g_i;
+                T v_i = c.beta2 * v[i] + (1 - c.beta2) * g_i * g_i;
+                m[i] = m_i;
+                v[i] = v_i;
+                p[i] = p[i] * c.decay - c.step_size * m_i / (std::sqrt(v_i) * c.inv_sqrt_bc2 + c.eps);
+            }
+        }
+
+#ifdef __SSE2__
+        // std::sqrt may set errno, which keeps the loop above from being vectorized, so the x86
+        // baseline gets the same arithmetic, in the same order, spelled out in SSE2
+        inline void adam_range(float* p, const float* g, float* m, float* v, size_t i0, size_t i1, const Adam_Coefficients<float>& c) {
+            const __m128 beta1 = _mm_set1_ps(c.beta1), one_minus_beta1 = _mm_set1_ps(1 - c.beta1);
+            const __m128 beta2 = _mm_set1_ps(c.beta2), one_minus_beta2 = _mm_set1_ps(1 - c.beta2);
+            const __m128 eps = _mm_set1_ps(c.eps), step_size = _mm_set1_ps(c.step_size), inv_sqrt_bc2 = _mm_set1_ps(c.inv_sqrt_bc2);
+            const __m128 l2 = _mm_set1_ps(c.l2), decay = _mm_set1_ps(c.decay);
+            size_t i = i0;
+            for (; i + 4 <= i1; i += 4) {
+                const __m128 p_i = _mm_loadu_ps(p + i);
+                const __m128 g_i = _mm_add_ps(_mm_loadu_ps(g + i), _mm_mul_ps(l2, p_i));
+                const __m128 m_i = _mm_add_ps(_mm_mul_ps(beta1, _mm_loadu_ps(m + i)), _mm_mul_ps(one_minus_beta1, g_i));
+                const __m128 v_i = _mm_add_ps(_mm_mul_ps(beta2, _mm_loadu_ps(v + i)), _mm_mul_ps(_mm_mul_ps(one_minus_beta2, g_i), g_i));
+                _mm_storeu_ps(m + i, m_i);
+                _mm_storeu_ps(v + i, v_i);
+                const __m128 denom = _mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(v_i), inv_sqrt_bc2), eps);
+                _mm_storeu_ps(p + i, _mm_sub_ps(_mm_mul_ps(p_i, decay), _mm_div_ps(_mm_mul_ps(step_size, m_i), denom)));
+            }
+            adam_range<float>(p, g, m, v, i, i1, c);
+        }
+
+        inline void adam_range(double* p, const double* g, double* m, double* v, size_t i0, size_t i1, const Adam_Coefficients<double>& c) {
+            const __m128d beta1 = _mm_set1_pd(c.beta1), one_minus_beta1 = _mm_set1_pd(1 - c.beta1);
+            const __m128d beta2 = _mm_set1_pd(c.beta2), one_minus_beta2 = _mm_set1_pd(1 - c.beta2);
+            const __m128d eps = _mm_set1_pd(c.eps), step_size = _mm_set1_pd(c.step_size), inv_sqrt_bc2 = _mm_set1_pd(c.inv_sqrt_bc2);
+            const __m128d l2 = _mm_set1_pd(c.l2), decay = _mm_set1_pd(c.decay);
+            size_t i = i0;
+            for (; i + 2 <= i1; i += 2) {
+                const __m128d p_i = _mm_loadu_pd(p + i);
+                const __m128d g_i = _mm_add_pd(_mm_loadu_pd(g + i), _mm_mul_pd(l2, p_i));
+                const __m128d m_i = _mm_add_pd(_mm_mul_pd(beta1, _mm_loadu_pd(m + i)), _mm_mul_pd(one_minus_beta1, g_i));
+                const __m128d v_i = _mm_add_pd(_mm_mul_pd(beta2, _mm_loadu_pd(v + i)), _mm_mul_pd(_mm_mul_pd(one_minus_beta2, g_i), g_i));
+                _mm_storeu_pd(m + i, m_i);
+                _mm_storeu_pd(v + i, v_i);
+                const __m128d denom = _mm_add_pd(_mm_mul_pd(_mm_sqrt_pd(v_i), inv_sqrt_bc2), eps);
+                _mm_storeu_pd(p + i, _mm_sub_pd(_mm_mul_pd(p_i, decay), _mm_div_pd(_mm_mul_pd(step_size, m_i), denom)));
+            }
+            adam_range<double>(p, g, m, v, i, i1, c);
+        }
+#endif
+
+        template <typename T>
+        void adam_update(T* p, const T* g, T* m, T* v, size_t n, const Adam_Coefficients<T>& c) {
+            parallel::parallel_for(0, n, parallel::grain_for(1), [&](size_t i0, size_t i1) {
+                detail::adam_range(p, g, m, v, i0, i1, c);
+            });
+        }
+    }
+
     template <typename T>
     class Gradient_Descent: public Optimizer::Basic_Optimizer<T> {
     private:
-        std::vector<std::unique_ptr<Block::Layer::Linear_Layer<T>>> learnable_blocks;
+        // not owned: the layers belong to the network being trained
+        std::vector<Block::Layer::Linear_Layer<T>*> learnable_blocks;
+        // when set, all of them at once
+        Parameter_Arena<T>* arena = nullptr;
         T lr;
     public:
     Gradient_Descent() {
 
     }
-        Gradient_Descent (const std::vector<std::unique_ptr<Block::Layer::Linear_Layer<T>>>& learnable_blocks, T lr) {
+        Gradient_Descent (const std::vector<Block::Layer::Linear_Layer<T>*>& learnable_blocks, T lr) {
             this->learnable_blocks = learnable_blocks;
             this->lr = lr;
         }
 
+        Gradient_Descent (Parameter_Arena<T>& arena, T lr) {
+            this->arena = &arena;
+            this->lr = lr;
+        }
+
         void zero_grad() {
-            for (int i = 0; i < learnable_blocks.size(); i ++) {
+            if (this->arena != nullptr) {
+                this->arena->zero_grad();
+                return;
+            }
+            for (size_t i = 0; i < learnable_blocks.size(); i ++) {
                 learnable_blocks[i]->zero_grad();
             }
         }
 
        void step() {
+            if (this->arena != nullptr) {
+                detail::sgd_update<T>(this->arena->parameters(), this->arena->gradients(), this->arena->size(), this->lr);
+                return;
+            }
             for (size_t i = 0; i < learnable_blocks.size(); ++i) {
-                std::vector<std::valarray<T>> dW = learnable_blocks[i]->get_dW();
-                std::vector<std::valarray<T>> W = learnable_blocks[i]->get_W();
-                for (size_t j = 0; j < W.size(); ++j) {
-                    W[j] -= this->lr * dW[j];
+                tensor::Tensor<T>& W = learnable_blocks[i]->get_W();
+                const tensor::Tensor<T>& dW = learnable_blocks[i]->get_dW();
+                assert(W.size() == dW.size() && "A layer with bfloat16 weights cannot be trained.");
+                detail::sgd_update<T>(W.data(), dW.data(), W.size(), this->lr);
+
+                tensor::Tensor<T>& b = learnable_blocks[i]->get_b();
+                const tensor::Tensor<T>& db = learnable_blocks[i]->get_db();
+                detail::sgd_update<T>(b.data(), db.data(), b.size(), this->lr);
+            }
+        }
+    };
+
+    // SGD for a Sparse_Linear_Layer: steps only the rows of Wt (the columns of W) of the features
+    // that have a gradient, and b, so a step costs what the batches touched rather than the input width
+    template <typename T>
+    class Sparse_Gradient_Descent: public Optimizer::Basic_Optimizer<T> {
+    private:
+        Block::Layer::Sparse_Linear_Layer<T>& layer;
+        T lr;
+    public:
+        Sparse_Gradient_Descent(Block::Layer::Sparse_Linear_Layer<T>& layer, T lr) : layer(layer), lr(lr) {}
+
+        void zero_grad() {
+            this->layer.zero_grad();
+        }
+
+        void step() {
+            const std::vector<uint32_t>& features = this->layer.touched_features();
+            tensor::Tensor_View<const T> grad = this->layer.get_dWt_rows();
+            tensor::Tensor<T>& Wt = this->layer.get_Wt();
+            const size_t n = Wt.cols();
+            parallel::parallel_for(0, features.size(), parallel::grain_for(n), [&](size_t r0, size_t r1) {
+                for (size_t r = r0; r < r1; r ++) {
+                    T* w = Wt.row(features[r]);
+                    const T* g = grad.row(r);
+                    for (size_t j = 0; j < n; j ++) {
+                        w[j] -= this->lr * g[j];
+                    }
                 }
-                learnable_blocks[i]->set_W(W);
+            });
+            tensor::Tensor<T>& b = this->layer.get_b();
+            detail::sgd_update<T>(b.data(), this->layer.get_db().data(), b.size(), this->lr);
+        }
+    };
 
-                std::valarray<T> db = learnable_blocks[i]->get_db();
-                std::valarray<T> b = learnable_blocks[i]->get_b();
+    // SGD with (heavy-ball) momentum; the velocity has the arena's layout
+    template <typename T>
+    class Momentum_SGD: public Optimizer::Basic_Optimizer<T> {
+    private:
+        Parameter_Arena<T>& arena;
+        tensor::Tensor<T> velocity;
+        T lr;
+        T momentum;
+        T weight_decay;
+    public:
+        Momentum_SGD(Parameter_Arena<T>& arena, T lr, T momentum = 0.9, T weight_decay = 0) : arena(arena), velocity(1, arena.size(), static_cast<T>(0)), lr(lr), momentum(momentum), weight_decay(weight_decay) {}
 
-                b -= this->lr * db;
-                learnable_blocks[i]->set_b(b);
-            }
+        void zero_grad() {
+            this->arena.zero_grad();
+        }
+
+        void step() {
+            detail::momentum_update<T>(this->arena.parameters(), this->arena.gradients(), this->velocity.data(), this->arena.size(), this->lr, this->momentum, this->weight_decay);
         }
     };
-}
\ No newline at end of file
+
+    // Adam (Kingma & Ba), with the first and second moments in the arena's layout. weight_decay is
+    // an L2 term added to the gradient; AdamW below decouples it instead.
+    template <typename T>
+    class Adam: public Optimizer::Basic_Optimizer<T> {
+    protected:
+        Parameter_Arena<T>& arena;
+        tensor::Tensor<T> m;
+        tensor::Tensor<T> v;
+        T lr;
+        T beta1;
+        T beta2;
+        T eps;
+        T weight_decay;
+        bool decoupled_weight_decay = false;
+        size_t t = 0;
+    public:
+        Adam(Parameter_Arena<T>& arena, T lr = 1e-3, T beta1 = 0.9, T beta2 = 0.999, T eps = 1e-8, T weight_decay = 0)
+            : arena(arena), m(1, arena.size(), static_cast<T>(0)), v(1, arena.size(), static_cast<T>(0)), lr(lr), beta1(beta1), beta2(beta2), eps(eps), weight_decay(weight_decay) {}
+
+        void zero_grad() {
+            this->arena.zero_grad();
+        }
+
+        void step() {
+            this->t += 1;
+            const double bc1 = 1 - std::pow(static_cast<double>(this->beta1), static_cast<double>(this->t));
+            const double bc2 = 1 - std::pow(static_cast<double>(this->beta2), static_cast<double>(this->t));
+            detail::Adam_Coefficients<T> c;
+            c.beta1 = this->beta1;
+            c.beta2 = this->beta2;
+            c.eps = this->eps;
+            c.step_size = static_cast<T>(this->lr / bc1);
+            c.inv_sqrt_bc2 = static_cast<T>(1 / std::sqrt(bc2));
+            c.l2 = this->decoupled_weight_decay ? static_cast<T>(0) : this->weight_decay;
+            c.decay = this->decoupled_weight_decay ? static_cast<T>(1) - this->lr * this->weight_decay : static_cast<T>(1);
+            detail::adam_update<T>(this->arena.parameters(), this->arena.gradients(), this->m.data(), this->v.data(), this->arena.size(), c);
+        }
+
+        size_t num_steps() const {
+            return this->t;
+        }
+    };
+
+    // AdamW (Loshchilov & Hutter): weight decay shrinks the parameters directly, p *= 1 - lr * wd,
+    // instead of going through the adaptive moments
+    template <typename T>
+    class AdamW: public Adam<T> {
+    public:
+        AdamW(Parameter_Arena<T>& arena, T lr = 1e-3, T beta1 = 0.9, T beta2 = 0.999, T eps = 1e-8, T weight_decay = 1e-2)
+            : Adam<T>(arena, lr, beta1, beta2, eps, weight_decay) {
+            this->decoupled_weight_decay = true;
+        }
+    };
+}
+
+#endif
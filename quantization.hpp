@@ -0,0 +1,439 @@
+#ifndef QUANTIZATION_H
+#define QUANTIZATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUANTIZATION_X86 1
+#endif
+
+#include "tensor.hpp"
+#include "cpu_features.hpp"
+#include "thread_pool.hpp"
+
+// Post-training int8 quantization of linear layers, for inference.
+//
+// Weights are symmetric int8 per output channel, w = w_scale[o] * w_q with w_q in [-127, 127].
+// The input of a layer gets one asymmetric scale and zero point, x = x_scale * (x_q - zero_point),
+// picked from the range a calibration pass observed. x_q only uses 7 bits, [0, 127]: that way the
+// u8 x s8 pair sums of vpmaddubsw cannot saturate int16, and the AVX2, AVX-512 VNNI and generic
+// kernels all produce the same int32 sums.
+//
+//   y[o] = x_scale * w_scale[o] * (sum_k x_q[k] * w_q[o, k] - zero_point * sum_k w_q[o, k]) + b[o]
+//
+// The zero point term is a per-channel constant the accumulators start from; the scales are
+// applied when a tile is stored, right before the usual bias / activation epilogue.
+namespace quantization {
+
+    constexpr int32_t ACTIVATION_MAX = 127;
+    constexpr int32_t WEIGHT_MAX = 127;
+
+    // the kernels consume k in groups of 4 (one int32 lane of vpdpbusd) and output channels in
+    // panels of NR (one zmm, or two ymm, of int32 accumulators)
+    constexpr size_t K_GROUP = 4;
+    constexpr size_t NR = 16;
+
+    // smallest / largest value seen, e.g the input of a layer over the calibration set
+    struct Range {
+        float min = std::numeric_limits<float>::infinity();
+        float max = -std::numeric_limits<float>::infinity();
+
+        template <typename T>
+        void update(tensor::Tensor_View<const T> x) {
+            for (size_t i = 0; i < x.rows; i ++) {
+                const T* row = x.row(i);
+                for (size_t j = 0; j < x.cols; j ++) {
+                    this->min = std::min(this->min, static_cast<float>(row[j]));
+                    this->max = std::max(this->max, static_cast<float>(row[j]));
+                }
+            }
+        }
+
+        void merge(const Range& other) {
+            this->min = std::min(this->min, other.min);
+            this->max = std::max(this->max, other.max);
+        }
+
+        bool empty() const {
+            return this->min > this->max;
+        }
+
+        template <typename T>
+        static Range compute(tensor::Tensor_View<const T> x) {
+            return parallel::parallel_reduce(size_t(0), x.rows, parallel::grain_for(x.cols), Range(), [&](size_t i0, size_t i1) {
+                Range partial;
+                partial.update<T>(x.slice_rows(i0, i1 - i0));
+                return partial;
+            }, [](Range a, const Range& b) {
+                a.merge(b);
+                return a;
+            });
+        }
+    };
+
+    struct Activation_Params {
+        float scale = 1;
+        int32_t zero_point = 0;
+
+        // [min, max] onto [0, ACTIVATION_MAX], widened to contain 0 so that it is represented exactly
+        // (ReLU outputs, for one)
+        static Activation_Params from_range(const Range& range) {
+            Activation_Params params;
+            if (range.empty()) {
+                return params;
+            }
+            const double lo = std::min(0.0, static_cast<double>(range.min));
+            const double hi = std::max(0.0, static_cast<double>(range.max));
+            if (hi > lo) {
+                params.scale = static_cast<float>((hi - lo) / ACTIVATION_MAX);
+                params.zero_point = static_cast<int32_t>(std::lround(-lo / params.scale));
+                params.zero_point = std::clamp(params.zero_point, int32_t(0), ACTIVATION_MAX);
+            }
+            return params;
+        }
+    };
+
+    namespace detail {
+
+        inline size_t round_up(size_t n, size_t m) {
+            return (n + m - 1) / m * m;
+        }
+
+        inline int32_t load_group(const uint8_t* p) {
+            int32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // x_q rows of the current batch, per calling thread
+        inline tensor::Tensor<uint8_t>& activation_buffer() {
+            static thread_local tensor::Tensor<uint8_t> buffer;
+            return buffer;
+        }
+
+        // n values onto [0, ACTIVATION_MAX], then zeros up to padded (the matching weights are zero)
+        template <typename T>
+        void quantize_row(const T* x, size_t n, size_t padded, const Activation_Params& params, uint8_t* q) {
+            const float inv_scale = 1.0f / params.scale;
+            const float zero_point = static_cast<float>(params.zero_point);
+            for (size_t k = 0; k < n; k ++) {
+                float v = static_cast<float>(x[k]) * inv_scale + zero_point;
+                v = std::min(std::max(v, 0.0f), static_cast<float>(ACTIVATION_MAX));
+                // v >= 0, so truncating v + 0.5 rounds to nearest
+                q[k] = static_cast<uint8_t>(static_cast<int32_t>(v + 0.5f));
+            }
+            for (size_t k = n; k < padded; k ++) {
+                q[k] = 0;
+            }
+        }
+
+        // acc[ROWS][NP * NR] = init + x_q[ROWS, K] * (NP panels of w_q)^T, in the packed layout
+        template <size_t ROWS, size_t NP>
+        void kernel_generic(size_t k_groups, const uint8_t* x, size_t ldx, const int8_t* w, size_t panel_stride, const int32_t* init, int32_t* acc) {
+            for (size_t i = 0; i < ROWS; i ++) {
+                for (size_t p = 0; p < NP; p ++) {
+                    int32_t* c = acc + i * NP * NR + p * NR;
+                    const int8_t* panel = w + p * panel_stride;
+                    for (size_t j = 0; j < NR; j ++) {
+                        c[j] = init[p * NR + j];
+                    }
+                    for (size_t g = 0; g < k_groups; g ++) {
+                        const uint8_t* a = x + i * ldx + g * K_GROUP;
+                        const int8_t* b = panel + g * NR * K_GROUP;
+                        for (size_t j = 0; j < NR; j ++) {
+                            int32_t sum = 0;
+                            for (size_t u = 0; u < K_GROUP; u ++) {
+                                sum += static_cast<int32_t>(a[u]) * static_cast<int32_t>(b[j * K_GROUP + u]);
+                            }
+                            c[j] += sum;
+                        }
+                    }
+                }
+            }
+        }
+
+#ifdef QUANTIZATION_X86
+        // vpmaddubsw multiplies u8 x s8 and adds pairs into int16 (exact here, x_q < 128), vpmaddwd
+        // with ones adds those pairs into the int32 lane of each output channel
+        template <size_t ROWS>
+        __attribute__((target("avx2")))
+        void kernel_avx2(size_t k_groups, const uint8_t* x, size_t ldx, const int8_t* w, size_t, const int32_t* init, int32_t* acc) {
+            const __m256i ones = _mm256_set1_epi16(1);
+            __m256i c[ROWS][2];
+#pragma GCC unroll 8
+            for (size_t i = 0; i < ROWS; i ++) {
+                c[i][0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(init));
+                c[i][1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(init + 8));
+            }
+            for (size_t g = 0; g < k_groups; g ++) {
+                const __m256i b0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w + g * NR * K_GROUP));
+                const __m256i b1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(w + g * NR * K_GROUP + 32));
+#pragma GCC unroll 8
+                for (size_t i = 0; i < ROWS; i ++) {
+                    const __m256i a = _mm256_set1_epi32(detail::load_group(x + i * ldx + g * K_GROUP));
+                    c[i][0] = _mm256_add_epi32(c[i][0], _mm256_madd_epi16(_mm256_maddubs_epi16(a, b0), ones));
+                    c[i][1] = _mm256_add_epi32(c[i][1], _mm256_madd_epi16(_mm256_maddubs_epi16(a, b1), ones));
+                }
+            }
+#pragma GCC unroll 8
+            for (size_t i = 0; i < ROWS; i ++) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i * NR), c[i][0]);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i * NR + 8), c[i][1]);
+            }
+        }
+
+        // vpdpbusd does the u8 x s8 products and the sum of each group of 4 in one instruction
+        template <size_t ROWS, size_t NP>
+        __attribute__((target("avx512f,avx512bw,avx512vnni")))
+        void kernel_vnni(size_t k_groups, const uint8_t* x, size_t ldx, const int8_t* w, size_t panel_stride, const int32_t* init, int32_t* acc) {
+            __m512i c[ROWS][NP];
+#pragma GCC unroll 8
+            for (size_t i = 0; i < ROWS; i ++) {
+#pragma GCC unroll 2
+                for (size_t p = 0; p < NP; p ++) {
+                    c[i][p] = _mm512_loadu_si512(init + p * NR);
+                }
+            }
+            for (size_t g = 0; g < k_groups; g ++) {
+                __m512i b[NP];
+#pragma GCC unroll 2
+                for (size_t p = 0; p < NP; p ++) {
+                    b[p] = _mm512_load_si512(w + p * panel_stride + g * NR * K_GROUP);
+                }
+#pragma GCC unroll 8
+                for (size_t i = 0; i < ROWS; i ++) {
+                    const __m512i a = _mm512_set1_epi32(detail::load_group(x + i * ldx + g * K_GROUP));
+#pragma GCC unroll 2
+                    for (size_t p = 0; p < NP; p ++) {
+                        c[i][p] = _mm512_dpbusd_epi32(c[i][p], a, b[p]);
+                    }
+                }
+            }
+#pragma GCC unroll 8
+            for (size_t i = 0; i < ROWS; i ++) {
+#pragma GCC unroll 2
+                for (size_t p = 0; p < NP; p ++) {
+                    _mm512_storeu_si512(acc + i * NP * NR + p * NR, c[i][p]);
+                }
+            }
+        }
+#endif
+
+        enum class Kernel { Generic, AVX2, VNNI };
+
+        inline Kernel select_kernel() {
+#ifdef QUANTIZATION_X86
+            const cpu_features::Features& f = cpu_features::features();
+            if (cpu_features::active_isa() >= cpu_features::Isa::AVX512 && f.avx512bw && f.avx512_vnni) {
+                return Kernel::VNNI;
+            }
+            if (cpu_features::active_isa() >= cpu_features::Isa::AVX2) {
+                return Kernel::AVX2;
+            }
+#endif
+            return Kernel::Generic;
+        }
+
+        // register tile of each kernel: rows of x_q by panels of output channels
+        inline size_t tile_rows(Kernel kernel) {
+            return kernel == Kernel::VNNI ? 8 : 4;
+        }
+        inline size_t tile_panels(Kernel kernel) {
+            return kernel == Kernel::VNNI ? 2 : 1;
+        }
+
+        template <size_t ROWS>
+        void run_kernel(Kernel kernel, size_t np, size_t k_groups, const uint8_t* x, size_t ldx, const int8_t* w, size_t panel_stride, const int32_t* init, int32_t* acc) {
+#ifdef QUANTIZATION_X86
+            if (kernel == Kernel::VNNI) {
+                if (np == 2) {
+                    kernel_vnni<ROWS, 2>(k_groups, x, ldx, w, panel_stride, init, acc);
+                }
+                else {
+                    kernel_vnni<ROWS, 1>(k_groups, x, ldx, w, panel_stride, init, acc);
+                }
+                return;
+            }
+            if (kernel == Kernel::AVX2) {
+                kernel_avx2<ROWS>(k_groups, x, ldx, w, panel_stride, init, acc);
+                return;
+            }
+#endif
+            kernel_generic<ROWS, 1>(k_groups, x, ldx, w, panel_stride, init, acc);
+        }
+
+        // the row count is a template argument so every accumulator stays in a register; a bottom
+        // edge runs a shorter kernel instead of computing padding rows
+        inline void dispatch(Kernel kernel, size_t rows, size_t np, size_t k_groups, const uint8_t* x, size_t ldx, const int8_t* w, size_t panel_stride, const int32_t* init, int32_t* acc) {
+            switch (rows) {
+                case 1: run_kernel<1>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 2: run_kernel<2>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 3: run_kernel<3>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 4: run_kernel<4>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 5: run_kernel<5>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 6: run_kernel<6>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                case 7: run_kernel<7>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+                default: run_kernel<8>(kernel, np, k_groups, x, ldx, w, panel_stride, init, acc); break;
+            }
+        }
+    }
+
+    // W[out, inp] quantized per output channel and packed for the kernels: ceil(out / NR) panels,
+    // each holding ceil(inp / 4) groups of NR x 4 int8 (one output channel's 4 consecutive k next to
+    // each other), zero-padded past both edges. Carries the input parameters too, since they are
+    // folded into the per-channel constants the kernels use.
+    class Int8_Weights {
+    private:
+        size_t out_dim = 0;
+        size_t inp_dim = 0;
+        tensor::Tensor<int8_t> packed;
+        tensor::Tensor<float> w_scale;
+        Activation_Params input;
+        // per (padded) output channel: -zero_point * sum_k w_q[o, k], and x_scale * w_scale[o]
+        tensor::Tensor<int32_t> acc_init;
+        tensor::Tensor<float> dequant;
+
+        size_t _k_groups() const {
+            return (this->inp_dim + K_GROUP - 1) / K_GROUP;
+        }
+        size_t _panel_stride() const {
+            return this->_k_groups() * NR * K_GROUP;
+        }
+
+    public:
+        Int8_Weights() = default;
+
+        template <typename T>
+        Int8_Weights(const tensor::Tensor<T>& W, const Activation_Params& input) : out_dim(W.rows()), inp_dim(W.cols()), input(input) {
+            const size_t n_padded = detail::round_up(this->out_dim, NR);
+            this->packed = tensor::Tensor<int8_t>(1, n_padded * this->_k_groups() * K_GROUP, 0);
+            this->w_scale = tensor::Tensor<float>(1, this->out_dim);
+            this->acc_init = tensor::Tensor<int32_t>(1, n_padded, 0);
+            this->dequant = tensor::Tensor<float>(1, n_padded, 0.0f);
+
+            parallel::parallel_for(0, this->out_dim, parallel::grain_for(this->inp_dim), [&](size_t o0, size_t o1) {
+                for (size_t o = o0; o < o1; o ++) {
+                    const T* w = W.row(o);
+                    double abs_max = 0;
+                    for (size_t k = 0; k < this->inp_dim; k ++) {
+                        abs_max = std::max(abs_max, std::fabs(static_cast<double>(w[k])));
+                    }
+                    // an all-zero channel quantizes to zeros with any scale
+                    const double scale = abs_max > 0 ? abs_max / WEIGHT_MAX : 1.0;
+                    int8_t* panel = this->packed.data() + (o / NR) * this->_panel_stride();
+                    int32_t sum = 0;
+                    for (size_t k = 0; k < this->inp_dim; k ++) {
+                        long q = std::lround(static_cast<double>(w[k]) / scale);
+                        q = std::clamp(q, -long(WEIGHT_MAX), long(WEIGHT_MAX));
+                        panel[(k / K_GROUP) * NR * K_GROUP + (o % NR) * K_GROUP + k % K_GROUP] = static_cast<int8_t>(q);
+                        sum += static_cast<int32_t>(q);
+                    }
+                    this->w_scale[o] = static_cast<float>(scale);
+                    this->acc_init[o] = -this->input.zero_point * sum;
+                    this->dequant[o] = this->input.scale * static_cast<float>(scale);
+                }
+            });
+        }
+
+        bool empty() const {
+            return this->packed.empty();
+        }
+        size_t get_out_dim() const {
+            return this->out_dim;
+        }
+        size_t get_inp_dim() const {
+            return this->inp_dim;
+        }
+        const Activation_Params& get_input_params() const {
+            return this->input;
+        }
+        const tensor::Tensor<float>& get_weight_scales() const {
+            return this->w_scale;
+        }
+        // w_q[o, k], read back out of the packed layout
+        int8_t weight(size_t o, size_t k) const {
+            return this->packed[(o / NR) * this->_panel_stride() + (k / K_GROUP) * NR * K_GROUP + (o % NR) * K_GROUP + k % K_GROUP];
+        }
+        // what the layer keeps in memory for W
+        size_t bytes() const {
+            return this->packed.size() * sizeof(int8_t) + (this->w_scale.size() + this->dequant.size()) * sizeof(float) + this->acc_init.size() * sizeof(int32_t);
+        }
+
+        // out = dequant(quantize(x) * W_q^T), finished by the epilogue on each stored tile, which is
+        // where the bias and the activation come in. Rows are quantized once per call into a buffer
+        // of the calling thread, then row-block x channel-block tiles run on the pool; every output
+        // is a single int32 sum, so the result does not depend on the thread count.
+        template <typename T, typename Epilogue>
+        void gemm(tensor::Tensor_View<const T> x, tensor::Tensor_View<T> out, const Epilogue& epilogue) const {
+            assert(x.cols == this->inp_dim && "Input width does not match the quantized weights.");
+            assert(out.rows == x.rows && out.cols == this->out_dim && "Output must have shape [rows of x, out_dim].");
+            const size_t M = x.rows;
+            const size_t N = this->out_dim;
+            if (M == 0 || N == 0) {
+                return;
+            }
+            const size_t k_groups = this->_k_groups();
+            const size_t ldx = k_groups * K_GROUP;
+
+            tensor::Tensor<uint8_t>& x_q = detail::activation_buffer();
+            x_q.resize(M, ldx);
+            parallel::parallel_for(0, M, parallel::grain_for(this->inp_dim), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    detail::quantize_row<T>(x.row(i), this->inp_dim, ldx, this->input, x_q.row(i));
+                }
+            });
+
+            const detail::Kernel kernel = detail::select_kernel();
+            const size_t MR = detail::tile_rows(kernel);
+            const size_t NP = detail::tile_panels(kernel);
+            const size_t n_panels = (N + NR - 1) / NR;
+            const size_t n_tiles = (n_panels + NP - 1) / NP;
+            // a task is one column tile over up to 8 row blocks, so its weight panels are reused from
+            // cache while the rows stream past
+            const size_t rows_per_task = 8 * MR;
+            const size_t m_tasks = (M + rows_per_task - 1) / rows_per_task;
+            const size_t work_per_task = std::min(M, rows_per_task) * NP * NR * ldx;
+            const size_t n_tasks = n_tiles * m_tasks;
+            const size_t grain = std::max<size_t>(1, (size_t(1) << 18) / std::max<size_t>(1, work_per_task));
+
+            const uint8_t* x_data = x_q.data();
+            parallel::parallel_for(0, n_tasks, grain, [&](size_t t0, size_t t1) {
+                alignas(tensor::ALIGNMENT) int32_t acc[8 * 2 * NR];
+                for (size_t t = t0; t < t1; t ++) {
+                    const size_t tile = t / m_tasks;
+                    const size_t row_begin = (t % m_tasks) * rows_per_task;
+                    const size_t row_end = std::min(M, row_begin + rows_per_task);
+                    const size_t p0 = tile * NP;
+                    const size_t np = std::min(NP, n_panels - p0);
+                    const size_t col0 = p0 * NR;
+                    const size_t nc = std::min(np * NR, N - col0);
+                    const int8_t* w = this->packed.data() + p0 * this->_panel_stride();
+                    const int32_t* init = this->acc_init.data() + col0;
+                    const float* dq = this->dequant.data() + col0;
+
+                    for (size_t i0 = row_begin; i0 < row_end; i0 += MR) {
+                        const size_t mr = std::min(MR, row_end - i0);
+                        detail::dispatch(kernel, mr, np, k_groups, x_data + i0 * ldx, ldx, w, this->_panel_stride(), init, acc);
+                        for (size_t i = 0; i < mr; i ++) {
+                            const int32_t* a = acc + i * np * NR;
+                            T* c = out.row(i0 + i) + col0;
+                            for (size_t j = 0; j < nc; j ++) {
+                                c[j] = static_cast<T>(static_cast<float>(a[j]) * dq[j]);
+                            }
+                        }
+                        epilogue(out.row(i0) + col0, out.stride, i0, col0, mr, nc);
+                    }
+                }
+            });
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef QUANTIZATION_REPORT_H
+#define QUANTIZATION_REPORT_H
+
+#include <cmath>
+#include <chrono>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tensor.hpp"
+#include "nn.hpp"
+#include "ops_utils.hpp"
+
+namespace neural_network {
+
+    // how far a quantized model drifts from the model it was made from, on the same inputs
+    struct Quantization_Report {
+        size_t samples = 0;
+        // fraction of rows where both models predict the same class
+        double agreement = 0;
+        // against the labels, when the comparison was given some; -1 otherwise
+        double reference_accuracy = -1;
+        double quantized_accuracy = -1;
+        // logits: largest and mean absolute difference, and ||quantized - reference|| / ||reference||
+        double max_abs_error = 0;
+        double mean_abs_error = 0;
+        double relative_error = 0;
+        // bytes held for the weight matrices
+        size_t reference_weight_bytes = 0;
+        size_t quantized_weight_bytes = 0;
+        // no-grad inference over all the samples
+        double reference_rows_per_second = 0;
+        double quantized_rows_per_second = 0;
+
+        void print(std::ostream& out) const {
+            out << "samples " << this->samples << ", top-1 agreement " << this->agreement << "\n";
+            if (this->reference_accuracy >= 0) {
+                out << "accuracy: reference " << this->reference_accuracy << ", quantized " << this->quantized_accuracy << "\n";
+            }
+            out << "logit error: max " << this->max_abs_error << ", mean " << this->mean_abs_error << ", relative " << this->relative_error << "\n";
+            out << "weight bytes: reference " << this->reference_weight_bytes << ", quantized " << this->quantized_weight_bytes << "\n";
+            out << "rows/s: reference " << this->reference_rows_per_second << ", quantized " << this->quantized_rows_per_second << "\n";
+        }
+    };
+
+    namespace detail {
+        template <typename T>
+        size_t weight_bytes(const Neural_Network<T>& model) {
+            size_t bytes = 0;
+            for (const auto* layer : model.learnable_layers()) {
+                if (layer->has_int8_weights()) {
+                    bytes += layer->get_W_int8().bytes();
+                }
+                else if (layer->has_bf16_weights()) {
+                    bytes += layer->get_W_bf16().size() * sizeof(tensor::bfloat16);
+                }
+                else {
+                    bytes += layer->get_W().size() * sizeof(T);
+                }
+            }
+            return bytes;
+        }
+    }
+
+    // Runs both models over x in batches of batch_size rows and compares their logits and
+    // predictions; labels ([rows, 1] class indices, as Dataset holds them) may be empty.
+    template <typename T>
+    Quantization_Report compare_quantized(const Neural_Network<T>& reference, const Neural_Network<T>& quantized, tensor::Const_View<T> x, tensor::Const_View<T> labels = tensor::Tensor_View<const T>(), size_t batch_size = 256) {
+        if (labels.rows != 0 && labels.rows != x.rows) {
+            throw std::invalid_argument("labels must have one row per sample.");
+        }
+        if (batch_size == 0) {
+            throw std::invalid_argument("batch_size must be positive.");
+        }
+        Quantization_Report report;
+        report.samples = x.rows;
+        report.reference_weight_bytes = detail::weight_bytes(reference);
+        report.quantized_weight_bytes = detail::weight_bytes(quantized);
+        if (x.rows == 0) {
+            return report;
+        }
+
+        Inference_Buffers<T> reference_buffers, quantized_buffers;
+        double reference_seconds = 0, quantized_seconds = 0;
+        size_t agree = 0, reference_correct = 0, quantized_correct = 0, n_logits = 0;
+        double sum_abs = 0, sum_sq_diff = 0, sum_sq_ref = 0;
+        for (size_t b = 0; b < x.rows; b += batch_size) {
+            tensor::Tensor_View<const T> batch = x.slice_rows(b, std::min(batch_size, x.rows - b));
+
+            auto start = std::chrono::steady_clock::now();
+            tensor::Tensor_View<const T> ref = reference.infer_logits(batch, reference_buffers);
+            auto middle = std::chrono::steady_clock::now();
+            tensor::Tensor_View<const T> q = quantized.infer_logits(batch, quantized_buffers);
+            auto end = std::chrono::steady_clock::now();
+            reference_seconds += std::chrono::duration<double>(middle - start).count();
+            quantized_seconds += std::chrono::duration<double>(end - middle).count();
+
+            for (size_t i = 0; i < batch.rows; i ++) {
+                for (size_t j = 0; j < ref.cols; j ++) {
+                    double r = static_cast<double>(ref(i, j));
+                    double d = std::fabs(static_cast<double>(q(i, j)) - r);
+                    report.max_abs_error = std::max(report.max_abs_error, d);
+                    sum_abs += d;
+                    sum_sq_diff += d * d;
+                    sum_sq_ref += r * r;
+                }
+                n_logits += ref.cols;
+                size_t ref_class = ops_utils::find_max_and_argmax(ref.row(i), ref.cols).second;
+                size_t q_class = ops_utils::find_max_and_argmax(q.row(i), q.cols).second;
+                agree += (ref_class == q_class);
+                if (labels.rows != 0) {
+                    size_t label = static_cast<size_t>(labels(b + i, 0));
+                    reference_correct += (ref_class == label);
+                    quantized_correct += (q_class == label);
+                }
+            }
+        }
+
+        report.agreement = static_cast<double>(agree) / x.rows;
+        if (labels.rows != 0) {
+            report.reference_accuracy = static_cast<double>(reference_correct) / x.rows;
+            report.quantized_accuracy = static_cast<double>(quantized_correct) / x.rows;
+        }
+        report.mean_abs_error = sum_abs / n_logits;
+        report.relative_error = sum_sq_ref > 0 ? std::sqrt(sum_sq_diff / sum_sq_ref) : 0;
+        report.reference_rows_per_second = reference_seconds > 0 ? x.rows / reference_seconds : 0;
+        report.quantized_rows_per_second = quantized_seconds > 0 ? x.rows / quantized_seconds : 0;
+        return report;
+    }
+}
+
+#endif
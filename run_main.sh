@@ -4,5 +4,14 @@
 # cmake --build .
 # ./opt_utils
 
-g++ -o main main.cpp
-./main
\ No newline at end of file
+g++ -O3 -o main main.cpp
+./main
+
+# GEMM correctness against a long double reference and allocation-free steady-state steps
+# (non-zero exit on failure), then GFLOPS
+g++ -O3 -o gemm_test gemm_test.cpp
+./gemm_test
+g++ -O3 -o alloc_test alloc_test.cpp
+./alloc_test
+g++ -O3 -o gemm_bench gemm_bench.cpp
+./gemm_bench
@@ -0,0 +1,266 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+namespace data_utils {
+
+    // running count / mean / sum of squared deviations (Welford) plus min and max of one column.
+    // Two accumulators over disjoint data merge exactly (Chan et al.), so chunks can be summarized
+    // independently, on any thread, and combined afterwards.
+    struct Welford {
+        double count = 0;
+        double mean = 0;
+        double m2 = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+
+        void add(double x) {
+            this->count += 1;
+            double delta = x - this->mean;
+            this->mean += delta / this->count;
+            this->m2 += delta * (x - this->mean);
+            this->min = std::min(this->min, x);
+            this->max = std::max(this->max, x);
+        }
+
+        void merge(const Welford& other) {
+            if (other.count == 0) {
+                return;
+            }
+            if (this->count == 0) {
+                *this = other;
+                return;
+            }
+            double n = this->count + other.count;
+            double delta = other.mean - this->mean;
+            this->mean += delta * other.count / n;
+            this->m2 += other.m2 + delta * delta * this->count * other.count / n;
+            this->count = n;
+            this->min = std::min(this->min, other.min);
+            this->max = std::max(this->max, other.max);
+        }
+
+        // population variance
+        double variance() const {
+            return this->count > 0 ? this->m2 / this->count : 0;
+        }
+    };
+
+    template <typename T>
+    class Column_Stats {
+    private:
+        std::vector<Welford> columns;
+
+    public:
+        Column_Stats() = default;
+        explicit Column_Stats(size_t num_columns) : columns(num_columns) {}
+
+        // folds a block of rows in, row by row so memory is read in order
+        void update(tensor::Tensor_View<const T> X) {
+            if (this->columns.empty()) {
+                this->columns.resize(X.cols);
+            }
+            assert(X.cols == this->columns.size() && "Column count changed between updates.");
+            for (size_t i = 0; i < X.rows; i ++) {
+                const T* x = X.row(i);
+                for (size_t j = 0; j < X.cols; j ++) {
+                    this->columns[j].add(static_cast<double>(x[j]));
+                }
+            }
+        }
+
+        void merge(const Column_Stats& other) {
+            if (this->columns.empty()) {
+                this->columns = other.columns;
+                return;
+            }
+            assert(other.columns.empty() || other.columns.size() == this->columns.size());
+            for (size_t j = 0; j < other.columns.size(); j ++) {
+                this->columns[j].merge(other.columns[j]);
+            }
+        }
+
+        // one pass over X, row chunks summarized on the pool and merged in order
+        static Column_Stats compute(tensor::Tensor_View<const T> X) {
+            return parallel::parallel_reduce(size_t(0), X.rows, parallel::grain_for(X.cols), Column_Stats(X.cols), [&](size_t i0, size_t i1) {
+                Column_Stats partial(X.cols);
+                partial.update(X.slice_rows(i0, i1 - i0));
+                return partial;
+            }, [](Column_Stats a, const Column_Stats& b) {
+                a.merge(b);
+                return a;
+            });
+        }
+
+        size_t size() const {
+            return this->columns.size();
+        }
+        const Welford& operator[](size_t j) const {
+            return this->columns[j];
+        }
+        Welford& operator[](size_t j) {
+            return this->columns[j];
+        }
+    };
+
+    enum class Scaling { Min_Max, Z_Score };
+
+    // Per-column feature scaling. Both kinds reduce to out = (x - offset) * scale + base per column,
+    // which is what transform_row applies, so a loader can scale rows while it copies them into a
+    // batch. Subtracting first keeps columns with a large common offset exact at their endpoints.
+    //   Min_Max: [min, max] of each column onto [lo, hi]
+    //   Z_Score: (x - mean) / std
+    // A constant column, or one without observations, maps to lo (Min_Max) or 0 (Z_Score).
+    template <typename T>
+    class Scaler {
+    private:
+        Scaling kind;
+        T lo;
+        T hi;
+        Column_Stats<T> stats;
+        T base = 0;
+        std::vector<T> offset;
+        std::vector<T> scale;
+
+        // operator>> does not parse the "inf" / "-inf" that operator<< writes for the min and max of
+        // a column without observations, strtod does
+        static bool _read_number(std::istream& in, double& value) {
+            std::string token;
+            if (!(in >> token)) {
+                return false;
+            }
+            char* end = nullptr;
+            value = std::strtod(token.c_str(), &end);
+            return end == token.c_str() + token.size();
+        }
+
+        void _finalize() {
+            this->offset.assign(this->stats.size(), static_cast<T>(0));
+            this->scale.assign(this->stats.size(), static_cast<T>(1));
+            this->base = this->kind == Scaling::Min_Max ? this->lo : static_cast<T>(0);
+            for (size_t j = 0; j < this->stats.size(); j ++) {
+                const Welford& w = this->stats[j];
+                if (this->kind == Scaling::Min_Max) {
+                    double range = w.max - w.min;
+                    double s = range > 0 ? (static_cast<double>(this->hi) - static_cast<double>(this->lo)) / range : 0.0;
+                    // min is +inf without observations
+                    this->offset[j] = w.count > 0 ? static_cast<T>(w.min) : static_cast<T>(0);
+                    this->scale[j] = static_cast<T>(s);
+                }
+                else {
+                    double sd = std::sqrt(w.variance());
+                    double s = sd > 0 ? 1.0 / sd : 1.0;
+                    this->offset[j] = static_cast<T>(w.mean);
+                    this->scale[j] = static_cast<T>(s);
+                }
+            }
+        }
+
+    public:
+        Scaler(Scaling kind = Scaling::Min_Max, T lo = 0, T hi = 1) : kind(kind), lo(lo), hi(hi) {}
+
+        void fit(tensor::Tensor_View<const T> X) {
+            this->stats = Column_Stats<T>::compute(X);
+            this->_finalize();
+        }
+
+        // streaming fit: each call folds another block of rows into the statistics
+        void partial_fit(tensor::Tensor_View<const T> X) {
+            this->stats.merge(Column_Stats<T>::compute(X));
+            this->_finalize();
+        }
+
+        bool fitted() const {
+            return !this->scale.empty();
+        }
+        size_t num_features() const {
+            return this->scale.size();
+        }
+        const Column_Stats<T>& get_stats() const {
+            return this->stats;
+        }
+
+        // in and out may be the same row
+        void transform_row(const T* in, T* out) const {
+            const T* o = this->offset.data();
+            const T* s = this->scale.data();
+            const T b = this->base;
+            for (size_t j = 0; j < this->scale.size(); j ++) {
+                out[j] = (in[j] - o[j]) * s[j] + b;
+            }
+        }
+
+        void transform(tensor::Tensor_View<const T> X, tensor::Tensor_View<T> out) const {
+            assert(X.cols == this->scale.size() && out.rows == X.rows && out.cols == X.cols && "Scaler fitted on a different number of features.");
+            parallel::parallel_for(0, X.rows, parallel::grain_for(X.cols), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    this->transform_row(X.row(i), out.row(i));
+                }
+            });
+        }
+
+        void save(const std::string& file_name) const {
+            std::ofstream out(file_name);
+            if (!out) {
+                throw std::runtime_error("Unable to create file: " + file_name);
+            }
+            out << std::setprecision(17);
+            out << "nn-scaler 1\n";
+            out << "kind " << (this->kind == Scaling::Min_Max ? "min_max" : "z_score") << "\n";
+            out << "range " << static_cast<double>(this->lo) << " " << static_cast<double>(this->hi) << "\n";
+            out << "columns " << this->stats.size() << "\n";
+            // count mean m2 min max
+            for (size_t j = 0; j < this->stats.size(); j ++) {
+                const Welford& w = this->stats[j];
+                out << w.count << " " << w.mean << " " << w.m2 << " " << w.min << " " << w.max << "\n";
+            }
+            if (!out) {
+                throw std::runtime_error("Unable to write file: " + file_name);
+            }
+        }
+
+        static Scaler load(const std::string& file_name) {
+            std::ifstream in(file_name);
+            if (!in) {
+                throw std::runtime_error("Unable to open file: " + file_name);
+            }
+            std::string tag, kind_name;
+            int version = 0;
+            double lo = 0, hi = 1;
+            size_t columns = 0;
+            in >> tag >> version;
+            if (tag != "nn-scaler" || version != 1) {
+                throw std::runtime_error("Not a scaler file: " + file_name);
+            }
+            in >> tag >> kind_name >> tag >> lo >> hi >> tag >> columns;
+            if (!in || (kind_name != "min_max" && kind_name != "z_score")) {
+                throw std::runtime_error("Corrupt scaler file: " + file_name);
+            }
+            Scaler scaler(kind_name == "min_max" ? Scaling::Min_Max : Scaling::Z_Score, static_cast<T>(lo), static_cast<T>(hi));
+            scaler.stats = Column_Stats<T>(columns);
+            for (size_t j = 0; j < columns; j ++) {
+                Welford& w = scaler.stats[j];
+                if (!(_read_number(in, w.count) && _read_number(in, w.mean) && _read_number(in, w.m2) && _read_number(in, w.min) && _read_number(in, w.max))) {
+                    throw std::runtime_error("Corrupt scaler file: " + file_name);
+                }
+            }
+            scaler._finalize();
+            return scaler;
+        }
+    };
+}
+
+#endif
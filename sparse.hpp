@@ -0,0 +1,163 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+
+// Compressed sparse row (CSR) batches for inputs too wide to ever hold densely, e.g 1M hashed
+// one-hot / bag-of-words features with a few dozen nonzeros per row, and the two products a first
+// linear layer needs on them.
+namespace sparse {
+
+    // Row i holds the nonzeros row_ptr[i] .. row_ptr[i + 1] of col / values. The offsets are
+    // absolute, so a slice of rows only moves row_ptr. Column indices within a row need not be sorted;
+    // a repeated one counts as the sum of its values.
+    template <typename T>
+    struct CSR_View {
+        const uint64_t* row_ptr = nullptr;
+        const uint32_t* col = nullptr;
+        const T* values = nullptr;
+        size_t rows = 0;
+        size_t cols = 0;
+
+        size_t nnz() const {
+            return this->rows == 0 ? 0 : static_cast<size_t>(this->row_ptr[this->rows] - this->row_ptr[0]);
+        }
+
+        CSR_View slice_rows(size_t begin, size_t count) const {
+            assert(begin + count <= this->rows && "Row slice out of range.");
+            CSR_View res = *this;
+            res.row_ptr = this->row_ptr + begin;
+            res.rows = count;
+            return res;
+        }
+    };
+
+    template <typename T>
+    class CSR_Matrix {
+    private:
+        std::vector<uint64_t> row_ptr = {0};
+        std::vector<uint32_t> col;
+        std::vector<T> values;
+        size_t n_cols = 0;
+
+    public:
+        CSR_Matrix() = default;
+
+        explicit CSR_Matrix(size_t cols) : n_cols(cols) {}
+
+        size_t rows() const { return this->row_ptr.size() - 1; }
+        size_t cols() const { return this->n_cols; }
+        size_t nnz() const { return this->col.size(); }
+
+        CSR_View<T> view() const {
+            return CSR_View<T>{this->row_ptr.data(), this->col.data(), this->values.data(), this->rows(), this->n_cols};
+        }
+
+        // no rows, `cols` columns; keeps the capacity, so refilling a batch does not allocate
+        void clear(size_t cols) {
+            this->row_ptr.resize(1);
+            this->col.clear();
+            this->values.clear();
+            this->n_cols = cols;
+        }
+
+        void reserve(size_t rows, size_t nnz) {
+            this->row_ptr.reserve(rows + 1);
+            this->col.reserve(nnz);
+            this->values.reserve(nnz);
+        }
+
+        // throws std::out_of_range for a column index past cols()
+        void append_row(const uint32_t* idx, const T* val, size_t nnz) {
+            for (size_t j = 0; j < nnz; j ++) {
+                if (idx[j] >= this->n_cols) {
+                    throw std::out_of_range("CSR column index " + std::to_string(idx[j]) + " out of range.");
+                }
+            }
+            this->col.insert(this->col.end(), idx, idx + nnz);
+            this->values.insert(this->values.end(), val, val + nnz);
+            this->row_ptr.push_back(this->col.size());
+        }
+
+        // appends rows idx[0], ..., idx[count - 1] of src, in that order, e.g to assemble a shuffled batch
+        void append_rows(CSR_View<T> src, const size_t* idx, size_t count) {
+            assert(src.cols == this->n_cols && "CSR width mismatch.");
+            for (size_t i = 0; i < count; i ++) {
+                const size_t begin = src.row_ptr[idx[i]], end = src.row_ptr[idx[i] + 1];
+                this->col.insert(this->col.end(), src.col + begin, src.col + end);
+                this->values.insert(this->values.end(), src.values + begin, src.values + end);
+                this->row_ptr.push_back(this->col.size());
+            }
+        }
+
+        // The arrays themselves, for a loader that counts first and then fills them in parallel:
+        // after resize(rows, nnz) the caller writes all of row_ptr (row_ptr[0] = 0), col and values.
+        void resize(size_t rows, size_t nnz) {
+            this->row_ptr.resize(rows + 1);
+            this->col.resize(nnz);
+            this->values.resize(nnz);
+        }
+        // e.g once a loader has seen the largest index; no index may reach cols
+        void set_cols(size_t cols) {
+            this->n_cols = cols;
+        }
+        uint64_t* row_ptr_data() { return this->row_ptr.data(); }
+        uint32_t* col_data() { return this->col.data(); }
+        T* values_data() { return this->values.data(); }
+    };
+
+    // out = x * Wt + bias with Wt [x.cols, out.cols], i.e W stored transposed: every nonzero x(i, k)
+    // adds one contiguous row of Wt to row i of out. Rows are split across the pool.
+    template <typename T>
+    void spmm(CSR_View<T> x, tensor::Tensor_View<const T> Wt, const T* bias, tensor::Tensor_View<T> out) {
+        assert(Wt.rows == x.cols && out.rows == x.rows && out.cols == Wt.cols && "spmm shape mismatch.");
+        const size_t n = out.cols;
+        const size_t per_row = x.rows > 0 ? (x.nnz() / x.rows + 1) * n : n;
+        parallel::parallel_for(0, x.rows, parallel::grain_for(per_row), [&](size_t i0, size_t i1) {
+            for (size_t i = i0; i < i1; i ++) {
+                T* o = out.row(i);
+                for (size_t j = 0; j < n; j ++) {
+                    o[j] = bias != nullptr ? bias[j] : static_cast<T>(0);
+                }
+                for (uint64_t p = x.row_ptr[i]; p < x.row_ptr[i + 1]; p ++) {
+                    const T v = x.values[p];
+                    const T* w = Wt.row(x.col[p]);
+                    for (size_t j = 0; j < n; j ++) {
+                        o[j] += v * w[j];
+                    }
+                }
+            }
+        });
+    }
+
+    // Row-sparse x^T * dZ: for every nonzero x(i, k), grad[slot[k], :] += x(i, k) * dZ[i, :], i.e the
+    // rows of dWt for the features present, packed at the rows `slot` gives them. The columns are
+    // split across the pool, so every thread walks all the nonzeros in order over its own columns:
+    // no two threads write the same element and the sums do not depend on the thread count.
+    template <typename T>
+    void spmm_tn_rows(CSR_View<T> x, tensor::Tensor_View<const T> dZ, const uint32_t* slot, tensor::Tensor_View<T> grad) {
+        assert(dZ.rows == x.rows && grad.cols == dZ.cols && "spmm_tn_rows shape mismatch.");
+        parallel::parallel_for(0, dZ.cols, std::max<size_t>(16, parallel::grain_for(x.nnz())), [&](size_t j0, size_t j1) {
+            for (size_t i = 0; i < x.rows; i ++) {
+                const T* d = dZ.row(i);
+                for (uint64_t p = x.row_ptr[i]; p < x.row_ptr[i + 1]; p ++) {
+                    const T v = x.values[p];
+                    T* g = grad.row(slot[x.col[p]]);
+                    for (size_t j = j0; j < j1; j ++) {
+                        g[j] += v * d[j];
+                    }
+                }
+            }
+        });
+    }
+}
+
+#endif
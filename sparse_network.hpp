@@ -0,0 +1,95 @@
+#ifndef SPARSE_NETWORK_H
+#define SPARSE_NETWORK_H
+
+#include <string>
+#include <vector>
+#include <valarray>
+#include <utility>
+#include <stdexcept>
+
+#include "tensor.hpp"
+#include "sparse.hpp"
+#include "nn.hpp"
+
+namespace neural_network {
+
+    // the buffers of the no-grad path, per caller as for Neural_Network
+    template <typename T>
+    struct Sparse_Inference_Buffers {
+        tensor::Tensor<T> hidden;
+        Inference_Buffers<T> body;
+    };
+
+    // A Sparse_Linear_Layer in front of a dense Neural_Network, for CSR inputs far too wide to hold
+    // densely: the first layer maps the sparse features to body_dims[0] hidden units and the body,
+    // built as Neural_Network builds it (e.g "relu-linear-relu-linear"), takes it from there.
+    //
+    // A training step is zero_grad(), forward(), backward(), then a Sparse_Gradient_Descent step on
+    // get_input_layer() and any optimizer on get_body() (e.g over its parameter_arena()).
+    template <typename T>
+    class Sparse_Input_Network {
+    private:
+        Block::Layer::Sparse_Linear_Layer<T> input_layer;
+        Neural_Network<T> body;
+        // output of the input layer, the input of the body until backward() has run
+        tensor::Tensor<T> hidden;
+
+        static std::valarray<int> _check_dims(const std::valarray<int>& body_dims) {
+            if (body_dims.size() == 0 || body_dims[0] <= 0) {
+                throw std::invalid_argument("body_dims[0], the width the sparse input is mapped to, must be positive.");
+            }
+            return body_dims;
+        }
+
+    public:
+        Sparse_Input_Network(size_t inp_dim, const std::string& body_architecture, std::valarray<int> body_dims)
+            : input_layer(static_cast<size_t>(_check_dims(body_dims)[0]), inp_dim), body(body_architecture, body_dims) {}
+
+        // x is referenced, not copied, so it has to stay alive until backward() has run; target and
+        // normalizer as for Neural_Network::forward
+        std::pair<tensor::Tensor_View<const T>, T> forward(sparse::CSR_View<T> x_batch, tensor::Tensor_View<const T> target, size_t normalizer = 0) {
+            this->hidden.resize(x_batch.rows, this->input_layer.get_out_dim());
+            this->input_layer.forward(x_batch, this->hidden.view());
+            return this->body.forward(this->hidden.view(), target, normalizer);
+        }
+
+        void backward() {
+            this->input_layer.backward(this->body.backward());
+        }
+
+        void zero_grad() {
+            this->input_layer.zero_grad();
+            this->body.zero_grad();
+        }
+
+        tensor::Tensor_View<const T> infer_logits(sparse::CSR_View<T> x_batch, Sparse_Inference_Buffers<T>& buffers) const {
+            buffers.hidden.resize(x_batch.rows, this->input_layer.get_out_dim());
+            this->input_layer.infer(x_batch, buffers.hidden.view());
+            return this->body.infer_logits(buffers.hidden.view(), buffers.body);
+        }
+
+        std::vector<T> predict(sparse::CSR_View<T> x_batch, Sparse_Inference_Buffers<T>& buffers) const {
+            tensor::Tensor_View<const T> logits = this->infer_logits(x_batch, buffers);
+            std::vector<T> res;
+            for (size_t i = 0; i < logits.rows; i ++) {
+                res.push_back(ops_utils::find_max_and_argmax(logits.row(i), logits.cols).second);
+            }
+            return res;
+        }
+
+        Block::Layer::Sparse_Linear_Layer<T>& get_input_layer() {
+            return this->input_layer;
+        }
+        const Block::Layer::Sparse_Linear_Layer<T>& get_input_layer() const {
+            return this->input_layer;
+        }
+        Neural_Network<T>& get_body() {
+            return this->body;
+        }
+        const Neural_Network<T>& get_body() const {
+            return this->body;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef STATIC_NETWORK_H
+#define STATIC_NETWORK_H
+
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+#include "tensor.hpp"
+#include "thread_pool.hpp"
+#include "activation_kernels.hpp"
+#include "ops_utils.hpp"
+#include "nn.hpp"
+
+// A network whose layer list and dimensions are template parameters, for fixed models in
+// production, e.g
+//
+//   Static_Network<float, Linear<784, 256>, ReLU, Linear<256, 10>>
+//
+// Every loop bound is a constant, so the compiler unrolls and vectorizes each layer for its exact
+// shape; layers are called directly (no virtual dispatch), the parameters live inside the object
+// and the activations in fixed-size arrays on the stack, so inference never allocates. It is meant
+// for small models, where per-layer overhead is what dominates the latency; the parameters make the
+// object as big as the model, so anything but a small one belongs in static or heap storage.
+namespace neural_network {
+
+    namespace static_layers {
+
+        // Linear<Inp, Out>: inp_dim inputs to out_dim outputs (the order data flows in, unlike
+        // Linear_Layer's (out_dim, inp_dim) constructor)
+        template <size_t Inp, size_t Out>
+        struct Linear {
+            static_assert(Inp > 0 && Out > 0, "Linear dimensions must be positive.");
+            static constexpr const char* name = "linear";
+            static constexpr bool learnable = true;
+            static constexpr size_t inp_dim = Inp;
+            static constexpr size_t out_dim = Out;
+
+            static constexpr size_t output_dim(size_t) {
+                return Out;
+            }
+
+            // W stored transposed, [Inp, Out], so the inner loop runs over contiguous outputs and
+            // vectorizes without horizontal sums
+            template <typename T>
+            struct Params {
+                alignas(tensor::ALIGNMENT) T Wt[Inp * Out] = {};
+                alignas(tensor::ALIGNMENT) T b[Out] = {};
+            };
+
+            template <typename T, size_t N>
+            static void forward(const Params<T>& params, const T* x, T* y) {
+                static_assert(N == Inp, "Linear input width does not match the previous layer.");
+                for (size_t o = 0; o < Out; o ++) {
+                    y[o] = params.b[o];
+                }
+                for (size_t k = 0; k < Inp; k ++) {
+                    const T x_k = x[k];
+                    const T* w = params.Wt + k * Out;
+                    for (size_t o = 0; o < Out; o ++) {
+                        y[o] += x_k * w[o];
+                    }
+                }
+            }
+
+            template <typename T>
+            static void load(Params<T>& params, const Block::Layer::Linear_Layer<T>& layer) {
+                if (layer.get_inp_dim() != Inp || layer.get_out_dim() != Out) {
+                    throw std::invalid_argument("Linear layer dimensions do not match the static network.");
+                }
+                const tensor::Tensor<T>& W = layer.get_W();
+                if (W.empty()) {
+                    throw std::invalid_argument("Only float weights can be loaded into a static network.");
+                }
+                for (size_t o = 0; o < Out; o ++) {
+                    for (size_t k = 0; k < Inp; k ++) {
+                        params.Wt[k * Out + o] = W(o, k);
+                    }
+                    params.b[o] = layer.get_b()[o];
+                }
+            }
+        };
+
+        // elementwise layers keep the width of their input and hold no parameters
+        struct Elementwise {
+            static constexpr bool learnable = false;
+
+            static constexpr size_t output_dim(size_t inp_dim) {
+                return inp_dim;
+            }
+            template <typename T>
+            struct Params {};
+        };
+
+        struct ReLU : Elementwise {
+            static constexpr const char* name = "relu";
+
+            template <typename T, size_t N>
+            static void forward(const Params<T>&, const T* x, T* y) {
+                for (size_t i = 0; i < N; i ++) {
+                    y[i] = x[i] >= 0 ? x[i] : 0;
+                }
+            }
+        };
+
+        struct Sigmoid : Elementwise {
+            static constexpr const char* name = "sigmoid";
+
+            template <typename T, size_t N>
+            static void forward(const Params<T>&, const T* x, T* y) {
+                act_kernels::sigmoid_forward<T>(x, y, N);
+            }
+        };
+
+        struct Tanh : Elementwise {
+            static constexpr const char* name = "tanh";
+
+            template <typename T, size_t N>
+            static void forward(const Params<T>&, const T* x, T* y) {
+                act_kernels::tanh_forward<T>(x, y, N);
+            }
+        };
+    }
+
+    template <typename T, typename... Layers>
+    class Static_Network {
+    private:
+        static_assert(sizeof...(Layers) > 0, "A static network needs at least one layer.");
+
+        using Layer_List = std::tuple<Layers...>;
+        template <size_t I>
+        using Layer = std::tuple_element_t<I, Layer_List>;
+
+        static constexpr size_t num_layers = sizeof...(Layers);
+
+    public:
+        // dims[i] is the input width of layer i, dims[num_layers] the number of logits
+        static constexpr std::array<size_t, num_layers + 1> dims = [] {
+            std::array<size_t, num_layers + 1> d = {};
+            d[0] = Layer<0>::inp_dim;
+            size_t i = 0;
+            ((d[i + 1] = Layers::output_dim(d[i]), i += 1), ...);
+            return d;
+        }();
+        static constexpr size_t input_dim = dims[0];
+        static constexpr size_t output_dim = dims[num_layers];
+
+    private:
+        // even layers write to ping, odd ones to pong, as in Neural_Network::infer_logits
+        static constexpr size_t buffer_width(size_t parity) {
+            size_t width = 1;
+            for (size_t i = parity; i < num_layers; i += 2) {
+                width = std::max(width, dims[i + 1]);
+            }
+            return width;
+        }
+
+        std::tuple<typename Layers::template Params<T>...> params;
+
+        // layer I reads x and writes its output to ping / pong, or to out for the last one
+        template <size_t I>
+        void _run(const T* x, T* ping, T* pong, T* out) const {
+            T* y = (I + 1 == num_layers) ? out : (I % 2 == 0 ? ping : pong);
+            Layer<I>::template forward<T, dims[I]>(std::get<I>(this->params), x, y);
+            if constexpr (I + 1 < num_layers) {
+                this->_run<I + 1>(y, ping, pong, out);
+            }
+        }
+
+        template <size_t... I>
+        void _load(const std::vector<const Block::Layer::Linear_Layer<T>*>& linear, std::index_sequence<I...>) {
+            size_t next = 0;
+            auto load_one = [&](auto index) {
+                constexpr size_t i = decltype(index)::value;
+                if constexpr (Layer<i>::learnable) {
+                    Layer<i>::load(std::get<i>(this->params), *linear[next]);
+                    next += 1;
+                }
+            };
+            (load_one(std::integral_constant<size_t, I>()), ...);
+        }
+
+    public:
+        // all parameters zero
+        Static_Network() = default;
+
+        // copies the parameters of a trained model with the same architecture and dimensions
+        explicit Static_Network(const Neural_Network<T>& model) {
+            this->load(model);
+        }
+
+        // "linear-relu-linear" style, as Neural_Network spells it
+        static std::string architecture() {
+            std::string res;
+            const char* names[] = {Layers::name...};
+            for (size_t i = 0; i < num_layers; i ++) {
+                res += (i > 0 ? "-" : "") + std::string(names[i]);
+            }
+            return res;
+        }
+
+        void load(const Neural_Network<T>& model) {
+            if (model.get_architecture() != Static_Network::architecture()) {
+                throw std::invalid_argument("Model architecture " + model.get_architecture() + " does not match the static network " + Static_Network::architecture() + ".");
+            }
+            std::vector<const Block::Layer::Linear_Layer<T>*> linear = model.learnable_layers();
+            this->_load(linear, std::index_sequence_for<Layers...>());
+        }
+
+        template <size_t I>
+        typename Layer<I>::template Params<T>& layer_params() {
+            return std::get<I>(this->params);
+        }
+        template <size_t I>
+        const typename Layer<I>::template Params<T>& layer_params() const {
+            return std::get<I>(this->params);
+        }
+
+        // one sample: x has input_dim values, logits receives output_dim
+        void infer(const T* x, T* logits) const {
+            alignas(tensor::ALIGNMENT) T ping[buffer_width(0)];
+            alignas(tensor::ALIGNMENT) T pong[buffer_width(1)];
+            this->_run<0>(x, ping, pong, logits);
+        }
+
+        // a batch, rows split across the pool when there is enough work
+        void infer(tensor::Tensor_View<const T> x, tensor::Tensor_View<T> logits) const {
+            if (x.cols != input_dim || logits.cols != output_dim || logits.rows != x.rows) {
+                throw std::invalid_argument("Batch shape does not match the static network.");
+            }
+            size_t work = 0;
+            for (size_t i = 0; i < num_layers; i ++) {
+                work += dims[i] * dims[i + 1];
+            }
+            parallel::parallel_for(0, x.rows, parallel::grain_for(work), [&](size_t i0, size_t i1) {
+                for (size_t i = i0; i < i1; i ++) {
+                    this->infer(x.row(i), logits.row(i));
+                }
+            });
+        }
+
+        // index of the largest logit
+        size_t predict(const T* x) const {
+            alignas(tensor::ALIGNMENT) T logits[output_dim];
+            this->infer(x, logits);
+            return ops_utils::find_max_and_argmax(logits, output_dim).second;
+        }
+    };
+}
+
+#endif
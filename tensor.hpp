@@ -0,0 +1,270 @@
+#ifndef TENSOR_H
+#define TENSOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <initializer_list>
+
+namespace tensor {
+
+    // every buffer handed out by the library starts on a cache line
+    constexpr size_t ALIGNMENT = 64;
+
+    // element type tag of the on-disk formats
+    enum class Dtype : uint32_t { Float32 = 1, Float64 = 2 };
+
+    template <typename T>
+    constexpr Dtype dtype_of() {
+        static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "Only float and double tensors can be stored.");
+        return std::is_same_v<T, float> ? Dtype::Float32 : Dtype::Float64;
+    }
+
+    namespace detail {
+        inline std::atomic<size_t>& allocation_counter() {
+            static std::atomic<size_t> counter{0};
+            return counter;
+        }
+    }
+
+    // number of buffers aligned_alloc has handed out since start-up; every tensor, pack buffer and
+    // workspace block goes through it, so two equal readings bracket an allocation-free region
+    inline size_t allocation_count() {
+        return detail::allocation_counter().load(std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    T* aligned_alloc(size_t count) {
+        if (count == 0) {
+            return nullptr;
+        }
+        detail::allocation_counter().fetch_add(1, std::memory_order_relaxed);
+        size_t bytes = (count * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        void* ptr = std::aligned_alloc(ALIGNMENT, bytes);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    template <typename T>
+    void aligned_free(T* ptr) {
+        std::free(const_cast<std::remove_const_t<T>*>(ptr));
+    }
+
+    // non-owning, row-major 2D window into a buffer; element (i, j) lives at data[i * stride + j]
+    template <typename T>
+    struct Tensor_View {
+        T* data = nullptr;
+        size_t rows = 0;
+        size_t cols = 0;
+        size_t stride = 0;
+
+        Tensor_View() = default;
+        Tensor_View(T* data, size_t rows, size_t cols, size_t stride) : data(data), rows(rows), cols(cols), stride(stride) {}
+        Tensor_View(T* data, size_t rows, size_t cols) : Tensor_View(data, rows, cols, cols) {}
+
+        // a mutable view is usable wherever a read-only one is expected
+        template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T> && !std::is_same_v<U, T>>>
+        Tensor_View(const Tensor_View<U>& other) : data(other.data), rows(other.rows), cols(other.cols), stride(other.stride) {}
+
+        T* row(size_t i) const {
+            return data + i * stride;
+        }
+        T& operator()(size_t i, size_t j) const {
+            return data[i * stride + j];
+        }
+        size_t size() const {
+            return rows * cols;
+        }
+        bool empty() const {
+            return rows == 0 || cols == 0;
+        }
+        bool is_contiguous() const {
+            return stride == cols || rows <= 1;
+        }
+
+        // copies src, of the same shape, into the viewed elements
+        void copy_from(Tensor_View<const std::remove_const_t<T>> src) const {
+            assert(src.rows == rows && src.cols == cols && "Shape mismatch in copy.");
+            for (size_t i = 0; i < rows; i ++) {
+                std::copy(src.row(i), src.row(i) + cols, row(i));
+            }
+        }
+
+        Tensor_View<T> slice_rows(size_t begin, size_t count) const {
+            assert(begin + count <= rows && "Row slice out of range.");
+            return Tensor_View<T>(data + begin * stride, count, cols, stride);
+        }
+        Tensor_View<T> slice_cols(size_t begin, size_t count) const {
+            assert(begin + count <= cols && "Column slice out of range.");
+            return Tensor_View<T>(data + begin, rows, count, stride);
+        }
+        Tensor_View<T> row_view(size_t i) const {
+            return slice_rows(i, 1);
+        }
+    };
+
+    namespace detail {
+        template <typename T>
+        struct Const_View_Of {
+            using type = Tensor_View<const T>;
+        };
+    }
+
+    // Tensor_View<const T> as a parameter of a function template that takes T from its other
+    // arguments: it is left out of deduction, so a Tensor_View<T> or a Tensor converts to it
+    template <typename T>
+    using Const_View = typename detail::Const_View_Of<T>::type;
+
+    // owning, row-major 2D matrix backed by a single 64-byte aligned buffer.
+    // vectors are stored as a single row, i.e shape [1, n].
+    // borrow() wraps memory owned by someone else instead, e.g a memory-mapped checkpoint; such a
+    // tensor never frees it, copies of it own their buffer, and it takes a buffer of its own if a
+    // resize has to grow it.
+    template <typename T>
+    class Tensor {
+    private:
+        T* buffer = nullptr;
+        size_t n_rows = 0;
+        size_t n_cols = 0;
+        size_t capacity = 0;
+        bool owning = true;
+
+        void _release() {
+            if (this->owning) {
+                tensor::aligned_free(this->buffer);
+            }
+        }
+
+    public:
+        Tensor() = default;
+
+        // the memory must outlive the tensor
+        static Tensor borrow(T* data, size_t rows, size_t cols) {
+            Tensor t;
+            t.buffer = data;
+            t.n_rows = rows;
+            t.n_cols = cols;
+            t.capacity = rows * cols;
+            t.owning = false;
+            return t;
+        }
+
+        Tensor(size_t rows, size_t cols) : n_rows(rows), n_cols(cols), capacity(rows * cols) {
+            this->buffer = tensor::aligned_alloc<T>(this->capacity);
+        }
+
+        Tensor(size_t rows, size_t cols, const T& value) : Tensor(rows, cols) {
+            this->fill(value);
+        }
+
+        Tensor(std::initializer_list<std::initializer_list<T>> values) : Tensor(values.size(), values.size() == 0 ? 0 : values.begin()->size()) {
+            size_t i = 0;
+            for (const auto& r : values) {
+                assert(r.size() == this->n_cols && "All rows must have the same length.");
+                std::copy(r.begin(), r.end(), this->row(i));
+                i += 1;
+            }
+        }
+
+        explicit Tensor(Tensor_View<const T> src) : Tensor(src.rows, src.cols) {
+            this->copy_from(src);
+        }
+
+        Tensor(const Tensor& other) : Tensor(other.n_rows, other.n_cols) {
+            std::copy(other.buffer, other.buffer + other.size(), this->buffer);
+        }
+
+        Tensor(Tensor&& other) noexcept {
+            this->swap(other);
+        }
+
+        Tensor& operator=(const Tensor& other) {
+            if (this != &other) {
+                this->resize(other.n_rows, other.n_cols);
+                std::copy(other.buffer, other.buffer + other.size(), this->buffer);
+            }
+            return *this;
+        }
+
+        Tensor& operator=(Tensor&& other) noexcept {
+            Tensor tmp(std::move(other));
+            this->swap(tmp);
+            return *this;
+        }
+
+        ~Tensor() {
+            this->_release();
+        }
+
+        void swap(Tensor& other) noexcept {
+            std::swap(this->buffer, other.buffer);
+            std::swap(this->n_rows, other.n_rows);
+            std::swap(this->n_cols, other.n_cols);
+            std::swap(this->capacity, other.capacity);
+            std::swap(this->owning, other.owning);
+        }
+
+        // reshapes in place; only touches the allocator when the buffer has to grow
+        void resize(size_t rows, size_t cols) {
+            if (rows * cols > this->capacity) {
+                this->_release();
+                this->capacity = rows * cols;
+                this->buffer = tensor::aligned_alloc<T>(this->capacity);
+                this->owning = true;
+            }
+            this->n_rows = rows;
+            this->n_cols = cols;
+        }
+
+        void fill(const T& value) {
+            std::fill(this->buffer, this->buffer + this->size(), value);
+        }
+
+        void copy_from(Tensor_View<const T> src) {
+            assert(src.rows == this->n_rows && src.cols == this->n_cols && "Shape mismatch in copy.");
+            for (size_t i = 0; i < src.rows; i ++) {
+                std::copy(src.row(i), src.row(i) + src.cols, this->row(i));
+            }
+        }
+
+        size_t rows() const { return this->n_rows; }
+        size_t cols() const { return this->n_cols; }
+        size_t stride() const { return this->n_cols; }
+        size_t size() const { return this->n_rows * this->n_cols; }
+        bool empty() const { return this->size() == 0; }
+        bool owns_data() const { return this->owning; }
+        std::pair<size_t, size_t> shape() const { return std::make_pair(this->n_rows, this->n_cols); }
+
+        T* data() { return this->buffer; }
+        const T* data() const { return this->buffer; }
+        T* row(size_t i) { return this->buffer + i * this->n_cols; }
+        const T* row(size_t i) const { return this->buffer + i * this->n_cols; }
+
+        T& operator()(size_t i, size_t j) { return this->buffer[i * this->n_cols + j]; }
+        const T& operator()(size_t i, size_t j) const { return this->buffer[i * this->n_cols + j]; }
+        // flat indexing, mostly for vectors stored as [1, n]
+        T& operator[](size_t i) { return this->buffer[i]; }
+        const T& operator[](size_t i) const { return this->buffer[i]; }
+
+        Tensor_View<T> view() { return Tensor_View<T>(this->buffer, this->n_rows, this->n_cols); }
+        Tensor_View<const T> view() const { return Tensor_View<const T>(this->buffer, this->n_rows, this->n_cols); }
+        operator Tensor_View<T>() { return this->view(); }
+        operator Tensor_View<const T>() const { return this->view(); }
+
+        Tensor_View<T> slice_rows(size_t begin, size_t count) { return this->view().slice_rows(begin, count); }
+        Tensor_View<const T> slice_rows(size_t begin, size_t count) const { return this->view().slice_rows(begin, count); }
+        Tensor_View<T> row_view(size_t i) { return this->view().row_view(i); }
+        Tensor_View<const T> row_view(size_t i) const { return this->view().row_view(i); }
+    };
+}
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Shared pool behind every multithreaded kernel in the library.
+//
+// A job is an index range cut into chunks. Each participant (the calling thread plus the workers)
+// starts with a contiguous share of the chunks and pops them from the front; once its own share is
+// empty it steals the back half of someone else's. Shares are a single [begin, end) word per thread,
+// so popping and stealing are one compare-and-swap each and a job never allocates.
+//
+// parallel_for / parallel_reduce called from inside a job body run inline on that thread, so
+// kernels can be nested freely (e.g a GEMM inside a data-parallel replica). Job bodies must not throw.
+namespace parallel {
+
+    struct Config {
+        // 0: NN_NUM_THREADS from the environment if set, otherwise one thread per hardware thread
+        size_t num_threads = 0;
+        // binds worker i to core i; the calling thread keeps its own affinity
+        bool pin_threads = false;
+        // cut reductions into chunks that depend only on the range and grain, not on the thread
+        // count, so results are bitwise reproducible whatever the pool size
+        bool deterministic = false;
+    };
+
+    namespace detail {
+
+        inline bool& inside_job() {
+            static thread_local bool flag = false;
+            return flag;
+        }
+
+        inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        // busy-waits for a short while, then yields so an oversubscribed machine still makes progress
+        template <typename Pred>
+        void spin_until(const Pred& done) {
+            for (int i = 0; !done(); i ++) {
+                if (i < 1000) {
+                    detail::cpu_relax();
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        inline size_t default_num_threads() {
+            if (const char* env = std::getenv("NN_NUM_THREADS")) {
+                long n = std::strtol(env, nullptr, 10);
+                if (n > 0) {
+                    return static_cast<size_t>(n);
+                }
+            }
+            return std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+
+        inline void pin_to_core(std::thread& thread, size_t core) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core % CPU_SETSIZE, &set);
+            pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+#else
+            (void)thread;
+            (void)core;
+#endif
+        }
+
+        // [begin, end) of chunk indices in one word: begin in the high half, end in the low half
+        inline uint64_t pack_range(uint64_t begin, uint64_t end) {
+            return (begin << 32) | end;
+        }
+        inline uint64_t range_begin(uint64_t r) {
+            return r >> 32;
+        }
+        inline uint64_t range_end(uint64_t r) {
+            return r & 0xffffffffu;
+        }
+
+        // one cache line per participant so pops on different threads do not false-share
+        struct alignas(64) Range_Slot {
+            std::atomic<uint64_t> range{0};
+        };
+    }
+
+    class Thread_Pool {
+    public:
+        // upper bound on the number of partial results parallel_reduce keeps (on the stack)
+        static constexpr size_t MAX_REDUCE_CHUNKS = 256;
+
+    private:
+        using Chunk_Fn = void (*)(const void* ctx, size_t chunk, size_t begin, size_t end);
+
+        // spins before a worker falls asleep; back-to-back kernels usually arrive well within it
+        static constexpr int SPIN_BEFORE_SLEEP = 2000;
+
+        Config config;
+        size_t n_threads;
+        std::vector<std::thread> workers;
+        std::unique_ptr<detail::Range_Slot[]> slots;
+
+        std::mutex job_mutex;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        std::atomic<bool> stop{false};
+        // generation of the latest job; open_generation is that job's number while it can still be joined, 0 otherwise
+        std::atomic<uint64_t> generation{0};
+        std::atomic<uint64_t> open_generation{0};
+        std::atomic<size_t> active{0};
+        std::atomic<size_t> pending{0};
+
+        // the job being run, only read by threads that joined it
+        Chunk_Fn job_fn = nullptr;
+        const void* job_ctx = nullptr;
+        size_t job_begin = 0;
+        size_t job_end = 0;
+        size_t job_chunk = 1;
+
+        template <typename F>
+        static void _invoke(const void* ctx, size_t chunk, size_t begin, size_t end) {
+            (*static_cast<const F*>(ctx))(chunk, begin, end);
+        }
+
+        bool _pop(size_t slot, size_t& chunk) {
+            std::atomic<uint64_t>& range = this->slots[slot].range;
+            uint64_t r = range.load(std::memory_order_acquire);
+            while (detail::range_begin(r) < detail::range_end(r)) {
+                if (range.compare_exchange_weak(r, detail::pack_range(detail::range_begin(r) + 1, detail::range_end(r)), std::memory_order_acq_rel)) {
+                    chunk = detail::range_begin(r);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // takes the back half of the first non-empty share after `thief`; keeps one chunk to run now
+        // and publishes the rest in the thief's own (empty) slot where others can steal it again
+        bool _steal(size_t thief, size_t& chunk) {
+            for (size_t k = 1; k < this->n_threads; k ++) {
+                std::atomic<uint64_t>& range = this->slots[(thief + k) % this->n_threads].range;
+                uint64_t r = range.load(std::memory_order_acquire);
+                while (detail::range_begin(r) < detail::range_end(r)) {
+                    uint64_t b = detail::range_begin(r);
+                    uint64_t e = detail::range_end(r);
+                    uint64_t mid = e - (e - b + 1) / 2;
+                    if (range.compare_exchange_weak(r, detail::pack_range(b, mid), std::memory_order_acq_rel)) {
+                        chunk = mid;
+                        this->slots[thief].range.store(detail::pack_range(mid + 1, e), std::memory_order_release);
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        void _run_chunk(size_t chunk) {
+            size_t b = this->job_begin + chunk * this->job_chunk;
+            size_t e = std::min(this->job_end, b + this->job_chunk);
+            this->job_fn(this->job_ctx, chunk, b, e);
+        }
+
+        void _participate(size_t slot) {
+            size_t chunk;
+            while (this->_pop(slot, chunk) || this->_steal(slot, chunk)) {
+                this->_run_chunk(chunk);
+                this->pending.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        void _worker_loop(size_t slot) {
+            detail::inside_job() = true;
+            uint64_t seen = 0;
+            while (true) {
+                uint64_t g = this->generation.load(std::memory_order_acquire);
+                for (int i = 0; i < SPIN_BEFORE_SLEEP && g == seen && !this->stop.load(std::memory_order_relaxed); i ++) {
+                    detail::cpu_relax();
+                    g = this->generation.load(std::memory_order_acquire);
+                }
+                if (g == seen) {
+                    std::unique_lock<std::mutex> lock(this->sleep_mutex);
+                    this->wake.wait(lock, [&] { return this->stop.load() || this->generation.load() != seen; });
+                    g = this->generation.load(std::memory_order_acquire);
+                }
+                if (this->stop.load()) {
+                    return;
+                }
+                seen = g;
+                // a late worker must not touch a job its caller has already closed
+                this->active.fetch_add(1);
+                if (this->open_generation.load() == g) {
+                    this->_participate(slot);
+                }
+                this->active.fetch_sub(1);
+            }
+        }
+
+        void _run(Chunk_Fn fn, const void* ctx, size_t begin, size_t end, size_t chunk_size) {
+            const size_t n_chunks = (end - begin + chunk_size - 1) / chunk_size;
+            std::lock_guard<std::mutex> job_lock(this->job_mutex);
+            this->job_fn = fn;
+            this->job_ctx = ctx;
+            this->job_begin = begin;
+            this->job_end = end;
+            this->job_chunk = chunk_size;
+            this->pending.store(n_chunks);
+            for (size_t s = 0; s < this->n_threads; s ++) {
+                this->slots[s].range.store(detail::pack_range(n_chunks * s / this->n_threads, n_chunks * (s + 1) / this->n_threads), std::memory_order_relaxed);
+            }
+
+            const uint64_t g = this->generation.load() + 1;
+            this->open_generation.store(g);
+            {
+                std::lock_guard<std::mutex> lock(this->sleep_mutex);
+                this->generation.store(g);
+            }
+            this->wake.notify_all();
+
+            detail::inside_job() = true;
+            this->_participate(0);
+            detail::spin_until([this] { return this->pending.load(std::memory_order_acquire) == 0; });
+            this->open_generation.store(0);
+            detail::spin_until([this] { return this->active.load() == 0; });
+            detail::inside_job() = false;
+        }
+
+        bool _serial(size_t n_chunks) const {
+            return this->n_threads == 1 || n_chunks <= 1 || detail::inside_job();
+        }
+
+    public:
+        explicit Thread_Pool(Config config = Config()) : config(config) {
+            this->n_threads = config.num_threads > 0 ? config.num_threads : detail::default_num_threads();
+            this->slots = std::make_unique<detail::Range_Slot[]>(this->n_threads);
+            for (size_t s = 1; s < this->n_threads; s ++) {
+                this->workers.emplace_back(&Thread_Pool::_worker_loop, this, s);
+                if (config.pin_threads) {
+                    detail::pin_to_core(this->workers.back(), s);
+                }
+            }
+        }
+
+        Thread_Pool(const Thread_Pool&) = delete;
+        Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+        ~Thread_Pool() {
+            {
+                std::lock_guard<std::mutex> lock(this->sleep_mutex);
+                this->stop.store(true);
+            }
+            this->wake.notify_all();
+            for (std::thread& t : this->workers) {
+                t.join();
+            }
+        }
+
+        // threads taking part in a job, the calling thread included
+        size_t size() const {
+            return this->n_threads;
+        }
+        const Config& get_config() const {
+            return this->config;
+        }
+
+        // body(b, e) over sub-ranges of [begin, end) no shorter than grain (except the last one)
+        template <typename F>
+        void parallel_for(size_t begin, size_t end, size_t grain, const F& body) {
+            if (end <= begin) {
+                return;
+            }
+            const size_t n = end - begin;
+            grain = std::max<size_t>(grain, 1);
+            // a few chunks per thread leaves room for stealing to even out the load
+            const size_t chunk = std::max(grain, (n + 8 * this->n_threads - 1) / (8 * this->n_threads));
+            if (this->_serial((n + chunk - 1) / chunk)) {
+                body(begin, end);
+                return;
+            }
+            auto wrapper = [&body](size_t, size_t b, size_t e) { body(b, e); };
+            this->_run(&Thread_Pool::_invoke<decltype(wrapper)>, &wrapper, begin, end, chunk);
+        }
+
+        // reduce(...reduce(reduce(identity, map(b0, e0)), map(b1, e1))...) with the chunk results
+        // combined in index order, so for a fixed chunking the result does not depend on scheduling
+        template <typename T, typename Map, typename Reduce>
+        T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, const Map& map, const Reduce& reduce) {
+            if (end <= begin) {
+                return identity;
+            }
+            const size_t n = end - begin;
+            grain = std::max<size_t>(grain, 1);
+            const size_t target = this->config.deterministic ? MAX_REDUCE_CHUNKS : std::min(MAX_REDUCE_CHUNKS, 8 * this->n_threads);
+            const size_t chunk = std::max({grain, (n + target - 1) / target, (n + MAX_REDUCE_CHUNKS - 1) / MAX_REDUCE_CHUNKS});
+            const size_t n_chunks = (n + chunk - 1) / chunk;
+
+            std::array<T, MAX_REDUCE_CHUNKS> partial;
+            if (this->_serial(n_chunks)) {
+                for (size_t c = 0; c < n_chunks; c ++) {
+                    partial[c] = map(begin + c * chunk, std::min(end, begin + (c + 1) * chunk));
+                }
+            }
+            else {
+                auto wrapper = [&](size_t c, size_t b, size_t e) { partial[c] = map(b, e); };
+                this->_run(&Thread_Pool::_invoke<decltype(wrapper)>, &wrapper, begin, end, chunk);
+            }
+            T result = identity;
+            for (size_t c = 0; c < n_chunks; c ++) {
+                result = reduce(result, partial[c]);
+            }
+            return result;
+        }
+    };
+
+    namespace detail {
+        inline std::unique_ptr<Thread_Pool>& pool_instance() {
+            static std::unique_ptr<Thread_Pool> pool = std::make_unique<Thread_Pool>();
+            return pool;
+        }
+    }
+
+    inline Thread_Pool& default_pool() {
+        return *detail::pool_instance();
+    }
+
+    // replaces the shared pool; must not be called while a kernel is running
+    inline void configure(const Config& config) {
+        detail::pool_instance() = std::make_unique<Thread_Pool>(config);
+    }
+
+    inline void set_num_threads(size_t num_threads) {
+        Config config = default_pool().get_config();
+        config.num_threads = num_threads;
+        parallel::configure(config);
+    }
+
+    inline size_t num_threads() {
+        return default_pool().size();
+    }
+
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, size_t grain, const F& body) {
+        default_pool().parallel_for(begin, end, grain, body);
+    }
+
+    template <typename T, typename Map, typename Reduce>
+    T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, const Map& map, const Reduce& reduce) {
+        return default_pool().parallel_reduce(begin, end, grain, identity, map, reduce);
+    }
+
+    // grain (in items) so that one chunk carries at least ~16k elements of work
+    inline size_t grain_for(size_t work_per_item) {
+        return std::max<size_t>(1, (size_t(1) << 14) / std::max<size_t>(1, work_per_item));
+    }
+}
+
+#endif
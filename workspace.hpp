@@ -0,0 +1,137 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+#include "tensor.hpp"
+
+namespace workspace {
+
+    // bump allocator for the buffers that only live for one training step: layer outputs, saved
+    // activations, gradients flowing backwards and loss scratch. allocate() hands out 64-byte aligned
+    // views and reset() releases all of them at once.
+    //
+    // Views stay valid until the next reset(), so the arena never moves memory while a step is running:
+    // when the current block is full a new one is chained on. At the following reset() the chain is
+    // replaced by a single block sized to the step's high-water mark, after which every step is served
+    // from that block and reset() is O(1).
+    class Arena {
+    private:
+        struct Block {
+            unsigned char* data;
+            size_t capacity;
+        };
+
+        // smallest block worth asking the system for
+        static constexpr size_t MIN_BLOCK = 64 * 1024;
+
+        std::vector<Block> blocks;
+        size_t offset = 0;
+        size_t in_use = 0;
+        size_t high_water = 0;
+
+        static size_t _round_up(size_t bytes) {
+            return (bytes + tensor::ALIGNMENT - 1) / tensor::ALIGNMENT * tensor::ALIGNMENT;
+        }
+
+        void _add_block(size_t bytes) {
+            size_t total = 0;
+            for (const Block& blk : this->blocks) {
+                total += blk.capacity;
+            }
+            size_t capacity = std::max({bytes, total, MIN_BLOCK});
+            this->blocks.push_back(Block{tensor::aligned_alloc<unsigned char>(capacity), capacity});
+            this->offset = 0;
+        }
+
+        void _release() {
+            for (const Block& blk : this->blocks) {
+                tensor::aligned_free(blk.data);
+            }
+            this->blocks.clear();
+        }
+
+    public:
+        Arena() = default;
+
+        explicit Arena(size_t bytes) {
+            this->reserve(bytes);
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        Arena(Arena&& other) noexcept {
+            this->swap(other);
+        }
+
+        Arena& operator=(Arena&& other) noexcept {
+            Arena tmp(std::move(other));
+            this->swap(tmp);
+            return *this;
+        }
+
+        ~Arena() {
+            this->_release();
+        }
+
+        void swap(Arena& other) noexcept {
+            std::swap(this->blocks, other.blocks);
+            std::swap(this->offset, other.offset);
+            std::swap(this->in_use, other.in_use);
+            std::swap(this->high_water, other.high_water);
+        }
+
+        // uninitialized [rows, cols] buffer, valid until the next reset()
+        template <typename T>
+        tensor::Tensor_View<T> allocate(size_t rows, size_t cols) {
+            size_t bytes = _round_up(rows * cols * sizeof(T));
+            if (this->blocks.empty() || this->offset + bytes > this->blocks.back().capacity) {
+                this->_add_block(bytes);
+            }
+            T* ptr = reinterpret_cast<T*>(this->blocks.back().data + this->offset);
+            this->offset += bytes;
+            this->in_use += bytes;
+            this->high_water = std::max(this->high_water, this->in_use);
+            return tensor::Tensor_View<T>(ptr, rows, cols);
+        }
+
+        // invalidates every view handed out so far
+        void reset() {
+            if (this->blocks.size() > 1) {
+                this->_release();
+                this->_add_block(this->high_water);
+            }
+            this->offset = 0;
+            this->in_use = 0;
+        }
+
+        // makes sure a step needing up to `bytes` runs without growing; only valid right after reset()
+        void reserve(size_t bytes) {
+            assert(this->in_use == 0 && "reserve() must not be called while views are live.");
+            if (this->capacity() < bytes || this->blocks.size() > 1) {
+                this->_release();
+                this->_add_block(_round_up(std::max(bytes, this->high_water)));
+            }
+        }
+
+        size_t bytes_in_use() const {
+            return this->in_use;
+        }
+        size_t high_water_mark() const {
+            return this->high_water;
+        }
+        size_t capacity() const {
+            size_t total = 0;
+            for (const Block& blk : this->blocks) {
+                total += blk.capacity;
+            }
+            return total;
+        }
+    };
+}
+
+#endif